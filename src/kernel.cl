@@ -1,406 +1,260 @@
-#define MYFLOAT_MANT_SIZE 28 // WE STORE THE IMPLICIT BIT
+//MYFLOAT.H AND THE GENERATED FORMULA ARE PREPENDED BY THE HOST
 
-typedef struct
-{
-    bool sign; //TRUE IF NEGATIVE
-    int exp;
-    bool mant[MYFLOAT_MANT_SIZE];
-} myFloat;
-
-myFloat createMyFloat()
-{
-    myFloat res;
+#ifdef NUMBER_TYPE_FLOAT
 
-    res.sign = false;
-    res.exp = -126;
+typedef float number;
 
-    for(int i = 0; i < MYFLOAT_MANT_SIZE; ++i) res.mant[i] = false;
+#define numFromFloat(f)         (f)
+#define numAdd(a, b)            ((a) + (b))
+#define numSubtract(a, b)       ((a) - (b))
+#define numMultiply(a, b)       ((a) * (b))
+#define numCompare(a, b)        (((a) > (b)) ? 1 : (((a) < (b)) ? -1 : 0))
+#define numAbs(a)               fabs(a)
 
-    return res;
-}
-
-myFloat convertFromFloat(float fNum)
-{
-    myFloat res = createMyFloat();
+#else
 
-    if(fNum == 0)
-        return res;
+typedef myFloat number;
 
-    res.sign = fNum < 0;
-    fNum = fNum >= 0 ? fNum : -fNum;
+#define numFromFloat(f)         convertFromFloat(f)
+#define numAdd(a, b)            add(a, b)
+#define numSubtract(a, b)       subtract(a, b)
+#define numMultiply(a, b)       multiply(a, b)
+#define numCompare(a, b)        compare(a, b)
+#define numAbs(a)               absolute(a)
 
-    int intPart = (int)fNum;
+#endif
 
+typedef struct
+{
+    int index;
     int i;
-    for(i = 0; i < MYFLOAT_MANT_SIZE && intPart != 0; ++i)
-    {
-        res.mant[i] = intPart % 2;
-        intPart /= 2;
-    }
-
-    //SHIFTING
-    for(int j = i - 1; j >= 0; --j)
-        res.mant[MYFLOAT_MANT_SIZE - i + j] = res.mant[j];
-    
-    float fracPart = fNum - (int)fNum;
+    number zr;
+    number zi;
+} orbit;
 
-    int firstOne = -1;
-
-    for (int j = MYFLOAT_MANT_SIZE - i - 1; j >= 0; --j)
-    {
-        double t = fracPart * 2;
-        
-        if(t >= 1.0)
-        {
-            if(firstOne == -1)
-                firstOne = j;
-                
-            fracPart = t - 1.0;
-            res.mant[j] = true;
-        }
-        else
-        {
-            fracPart = t;
-            res.mant[j] = false;
-        }
-    }
-
-    //SHIFTING WHEN NAT PART IS 0
-    if(i == 0)
-        for (int j = firstOne; j >= 0; --j)
-            res.mant[MYFLOAT_MANT_SIZE - firstOne + j - 1] = res.mant[j];
-
-    res.exp = i > 0 ? (i - 1) : -(MYFLOAT_MANT_SIZE) + firstOne;
-
-    return res;
-}
-
-float getAsFloat(myFloat mF)
+//ZOOM SPANS THE WIDTH, SO PIXELS STAY SQUARE WHEN W != H
+void pixelToPoint(int2 coord, int w, int h, float2 origin, float zoom, number *cr, number *ci)
 {
-    float res = 0;
-    for(int i = 0; i < MYFLOAT_MANT_SIZE; ++i)
-        if(mF.mant[i])
-            res += pow(2.0, mF.exp - MYFLOAT_MANT_SIZE + 1 + i);
+    *cr = numFromFloat((coord.x / (float)w) - 0.5);
+    *ci = numFromFloat((coord.y - 0.5f * h) / (float)w);
 
-    return (mF.sign ? (-1) : 1) * res;
+    *cr = numAdd(numMultiply(*cr, numFromFloat(zoom)), numFromFloat(origin.x));
+    *ci = numAdd(numMultiply(*ci, numFromFloat(zoom)), numFromFloat(origin.y));
 }
 
-bool exor(bool a, bool b)
-{
-	return ((a || b) && !(a && b));
+//FRACTAL_STEP(ZR, ZI, CR, CI) ADVANCES THE ORBIT BY ONE ITERATION IN PLACE, FRACTAL_JULIA
+//SELECTS THE JULIA KERNEL ARGUMENT AS C INSTEAD OF THE PIXEL
+#ifndef FRACTAL_STEP
+
+#define FRACTAL_JULIA 0
+#define FRACTAL_STEP(zr, zi, cr, ci) \
+{ \
+    number real = numSubtract(numMultiply(zr, zr), numMultiply(zi, zi)); \
+    zi = numMultiply(numMultiply(numFromFloat(2), zr), zi); \
+    zr = numAdd(real, cr); \
+    zi = numAdd(zi, ci); \
 }
 
-bool isZero(myFloat mF)
-{
-	bool b = true;
-
-	for(int i = 0; i < MYFLOAT_MANT_SIZE; ++i)
-		b = b && (mF.mant[i] == 0);
+#endif
 
-	return b;
-}
-
-bool isNaN(myFloat mF)
+//C OF THE FORMULA: THE PIXEL ITSELF, OR THE JULIA PARAMETER
+void pixelToConstant(int2 coord, int w, int h, float2 origin, float zoom, float2 julia, number *cr, number *ci)
 {
-	bool b = (mF.exp == 128);
-	bool bb = (mF.mant[MYFLOAT_MANT_SIZE - 1] == 1);
-
-    if(!bb)
-        return false;
-
-	for(int i = 0; i < MYFLOAT_MANT_SIZE - 1; ++i)
-		bb = bb && (mF.mant[i] == 0);
-
-	return (b && !bb);
+#if (FRACTAL_JULIA)
+    *cr = numFromFloat(julia.x);
+    *ci = numFromFloat(julia.y);
+#else
+    pixelToPoint(coord, w, h, origin, zoom, cr, ci);
+#endif
 }
 
-bool isInf(myFloat mF)
+//THE MANDELBROT FAMILY STARTS ONE STEP AFTER Z = 0, THAT IS Z = C
+void pixelToOrbit(int2 coord, int w, int h, float2 origin, float zoom, float2 julia, number *cr, number *ci, number *zr, number *zi)
 {
-	if(mF.sign)
-		return false;
-
-	bool b = (mF.exp == 128);
-	bool bb = (mF.mant[MYFLOAT_MANT_SIZE - 1] == 1);
-
-    if(!bb)
-        return false;
-
-	for(int i = 0; i < MYFLOAT_MANT_SIZE - 1; ++i)
-		bb = bb && (mF.mant[i] == 0);
-
-	return (b && bb);
+    pixelToPoint(coord, w, h, origin, zoom, zr, zi);
+
+#if (FRACTAL_JULIA)
+    pixelToConstant(coord, w, h, origin, zoom, julia, cr, ci);
+#else
+    *cr = *zr;
+    *ci = *zi;
+#endif
 }
 
-bool isNegInf(myFloat mF)
+//RUNS THE ORBIT FROM ITERATION I UP TO END, RETURNS END IF IT HAS NOT ESCAPED
+int iterateFrom(number cr, number ci, number *zr, number *zi, int i, int end)
 {
-	if(!mF.sign)
-		return false;
-
-	bool b = (mF.exp == 128);
-	bool bb = (mF.mant[MYFLOAT_MANT_SIZE - 1] == 1);
-
-    if(!bb)
-        return false;
-
-	for(int i = 0; i < MYFLOAT_MANT_SIZE; ++i)
-		bb = bb && (mF.mant[i] == 0);
+    for(; i < end; ++i)
+    {
+        FRACTAL_STEP((*zr), (*zi), cr, ci);
+        
+        if(numCompare(numAdd(numMultiply(*zr, *zr), numMultiply(*zi, *zi)), numFromFloat(4)) == 1)
+            break;
+    }
 
-	return (b && bb);
+    return i;
 }
 
-bool isDenormal(myFloat mF)
+int iterate(int2 coord, int w, int h, int max_iter, float2 origin, float zoom, float2 julia)
 {
-	return (mF.exp == -126);
+    number cr, ci, zr, zi;
+    pixelToOrbit(coord, w, h, origin, zoom, julia, &cr, &ci, &zr, &zi);
+
+    return iterateFrom(cr, ci, &zr, &zi, 0, max_iter);
 }
 
-int compare(myFloat mF1, myFloat mF2)
+uchar4 colorize(int i, int max_iter)
 {
-	//0 - EQUAL
-	//-1 - FIRST IS LESS
-	//1 - FIRST IS GREATER
-
-	if(mF1.sign && !mF2.sign)
-		return -1;
-	else if(!mF1.sign && mF2.sign)
-		return 1;
-	else
-	{
-		if(mF1.exp < mF2.exp)
-			return -1;
-		else if(mF1.exp > mF2.exp)
-			return 1;
-		else
-		{
-			for(int i = 0; i < MYFLOAT_MANT_SIZE; ++i)
-			{
-				if(!mF1.mant[MYFLOAT_MANT_SIZE - i - 1] && mF2.mant[MYFLOAT_MANT_SIZE - i - 1])
-					return -1;
-				else if(mF1.mant[MYFLOAT_MANT_SIZE - i - 1] && !mF2.mant[MYFLOAT_MANT_SIZE - i - 1])
-					return 1;
-				else
-					continue;
-			}
-
-			return 0;
-		}
-	}
+    float col = i == max_iter ? 0 : i / (float)max_iter;
+    float4 color = { col * (i / (255.0f * 255.0f)) * (1.0f / max_iter), col, col, 1.0f };
+    return convert_uchar4_sat_rte(color * 255.0f);
 }
 
-myFloat addUnsigned(myFloat mF1, myFloat mF2)
+//RESULT AND ITERATIONS ARE W X H IMAGES WITH ROWS PITCH PIXELS APART. THE NDRANGE IS
+//PADDED TO WHOLE WORK-GROUPS, SO ITEMS PAST THE EDGE HAVE NOTHING TO DO
+__kernel void mandelbrot(__global uchar4 *result, int w, int h, int max_iter, float2 origin, float zoom, __global int *iterations, int pitch, 
+                         float2 julia)
 {
-    if(mF1.exp < mF2.exp)
-    {
-        myFloat tmp = mF1;
-        mF1 = mF2;
-        mF2 = tmp;
-    }
+    int2 coord = { get_global_id(0), get_global_id(1) };
 
-    myFloat res = createMyFloat();
-    uint diff = mF1.exp - mF2.exp;
-    bool carry = false;
-    bool a = false;
-    bool b = false;
+    if(coord.x >= w || coord.y >= h)
+        return;
 
-    for(int i = 0; i < MYFLOAT_MANT_SIZE; ++i)
-    {
-        a = exor(mF1.mant[i], carry);
-        b = (i + diff < MYFLOAT_MANT_SIZE) ? mF2.mant[i + diff] : false;
-        res.mant[i] = exor(a, b);
-        carry = (mF1.mant[i] && b) || (mF1.mant[i] && carry) || (b && carry);
-    }
+    int index = coord.y * pitch + coord.x;
 
-    if(carry)
-    {
-        for(int i = 0; i + 1 < MYFLOAT_MANT_SIZE; ++i)
-            res.mant[i] = res.mant[i + 1];
+    int i = iterate(coord, w, h, max_iter, origin, zoom, julia);
 
-        res.mant[MYFLOAT_MANT_SIZE - 1] = true;
-    }
-
-    res.exp = carry ? mF1.exp + 1 : mF1.exp;
-    res.sign = false;
+    result[index] = colorize(i, max_iter);
 
-    return res;
+    if(iterations)
+        iterations[index] = i;
 }
 
-myFloat subtractUnsigned(myFloat mF1, myFloat mF2)
+//GROUPS RECEIVES (TOTAL, MAX, MAX - MEAN, ACTIVE PIXELS) FOR EVERY WORK-GROUP. THESE COUNT
+//ITERATIONS EXECUTED, WHICH FOR AN ESCAPED PIXEL IS ONE MORE THAN ITS ESCAPE INDEX
+__kernel void mandelbrot_analytics(__global int *iterations, __global int4 *groups, __local int2 *scratch, 
+                                   int w, int h, int max_iter, float2 origin, float zoom, float2 julia)
 {
-    myFloat res = createMyFloat();
-    uint diff = mF1.exp - mF2.exp;
-    bool carry = false;
-    bool b = false;
-    bool bCarry = false;
-    bool tmp = false;
-
-    for(int i = 0; i < MYFLOAT_MANT_SIZE; ++i)
-    {
-        tmp = (i + diff < MYFLOAT_MANT_SIZE) ? mF2.mant[i + diff] : false;
-        b = exor(tmp, carry);
-        bCarry = tmp && carry;
-        res.mant[i] = exor(mF1.mant[i], b);
-        carry = (!mF1.mant[i] && (tmp || carry)) || (mF1.mant[i] && bCarry);
-    }
-
-    int i = MYFLOAT_MANT_SIZE - 1;
-
-    while(i >= 0 && !res.mant[i])
-        i--;
-
-    int shift = 0;
-
-    if(i >= 0)
-    {
-        shift = MYFLOAT_MANT_SIZE - i - 1;
-
-        for(int j = 0; j < i; ++j)
-            res.mant[i - j + shift] = res.mant[i - j];
-
-        for(int i = 0; i < shift; ++i)
-            res.mant[i] = false;
-    }
+    int2 coord = { get_global_id(0), get_global_id(1) };
+    int2 size = { get_local_size(0), get_local_size(1) };
+    int lid = get_local_id(1) * size.x + get_local_id(0);
+    int n = size.x * size.y;
 
-    res.exp = mF1.exp - shift;
+    //PADDING ITEMS STILL TAKE PART IN THE REDUCTION, BUT CONTRIBUTE NOTHING
+    bool inside = coord.x < w && coord.y < h;
+    int i = inside ? iterate(coord, w, h, max_iter, origin, zoom, julia) : 0;
 
-    return res;
-}
+    if(inside)
+        iterations[coord.y * w + coord.x] = i;
 
-myFloat subtract(myFloat mF1, myFloat mF2)
-{
-    if(isZero(mF2))
-        return mF1;
+    int executed = (inside && i < max_iter) ? i + 1 : i;
+    scratch[lid] = (int2)(executed, executed);
+    barrier(CLK_LOCAL_MEM_FENCE);
 
-    myFloat res = createMyFloat();
-    bool prevSign = mF1.sign;
-
-    if(mF1.sign == mF2.sign)
+    for(int stride = 1; stride < n; stride *= 2)
     {
-        if(mF1.sign)
+        if(lid % (2 * stride) == 0 && lid + stride < n)
         {
-            mF1.sign = false;
-            mF2.sign = false;
+            int2 other = scratch[lid + stride];
+            scratch[lid] = (int2)(scratch[lid].x + other.x, max(scratch[lid].y, other.y));
         }
 
-        if(compare(mF1, mF2) == -1) // -2 - -4 -> 2 - 4 = +2
-        {
-            res = subtractUnsigned(mF2, mF1);
-            res.sign = !prevSign;
-        }
-        else
-        {
-            res = subtractUnsigned(mF1, mF2); //-4 - (-2) -> 2 - 4 = - 2
-            res.sign = prevSign;
-        }
+        barrier(CLK_LOCAL_MEM_FENCE);
     }
-    else // -2 - +4 || 2 - - 4 
-    {
-        mF1.sign = false;
-        mF2.sign = false;
-        res = addUnsigned(mF1, mF2);
-        res.sign = prevSign;
-    }
-
-    return res;
-}
 
-myFloat add(myFloat mF1, myFloat mF2)
-{
-    if(isZero(mF1))
-        return mF2;
-    else if(isZero(mF2))
-        return mF1;
-
-    myFloat res = createMyFloat();
-
-    if(!mF1.sign == mF2.sign)
+    if(lid == 0)
     {
-        bool mF1Sign = mF1.sign;
-        mF1.sign = false;
-        mF2.sign = false;
-        res = subtract(mF1, mF2);
-
-        res.sign = mF1Sign ? !res.sign : res.sign;
+        int2 group = { get_group_id(0), get_group_id(1) };
+        int active = min(size.x, w - group.x * size.x) * min(size.y, h - group.y * size.y);
+        int2 total = scratch[0];
 
-        return res;
-    }
-
-    if(mF1.sign)
-    {
-        res = addUnsigned(mF1, mF2);
-        res.sign = true;
+        groups[group.y * get_num_groups(0) + group.x] = (int4)(total.x, total.y, total.y - total.x / active, active);
     }
-    else
-        res = addUnsigned(mF1, mF2);
-
-    return res;
 }
 
-myFloat multiply(myFloat mF1, myFloat mF2)
+__kernel void orbit_size(__global int *size)
 {
-    myFloat res = createMyFloat();
+    size[0] = sizeof(orbit);
+}
 
-    if(isZero(mF1) || isZero(mF2))
-        return res;
+//ONLY AS MANY WORK-GROUPS AS THE DEVICE CAN RUN AT ONCE ARE LAUNCHED, AND EACH ONE KEEPS
+//TAKING WORK FROM COUNTERS[0] UNTIL THE ROUND IS DRAINED. WITHOUT AN INPUT QUEUE THE WORK
+//IS THE PIXEL TILES, OTHERWISE IT IS BUNDLES OF ORBITS LEFT OVER FROM THE PREVIOUS ROUND.
+//ORBITS THAT USE UP THEIR BUDGET ARE APPENDED TO THE OUTPUT QUEUE THROUGH COUNTERS[1].
+//THE QUEUES ARE PASSED AS BYTES SINCE ORBIT HOLDS BOOLS, WHICH KERNEL ARGUMENTS CANNOT.
+__kernel void mandelbrot_persistent(__global uchar4 *result, int w, int h, int max_iter, float2 origin, float zoom, 
+                                    __global int *iterations, __global int *counters, int budget, 
+                                    __global uchar *queue_in, int queue_in_count, __global uchar *queue_out, int pitch, 
+                                    float2 julia)
+{
+    __local int item;
 
-    bool carry = false;
-    int shift = 0;
+    int2 size = { get_local_size(0), get_local_size(1) };
+    int lid = get_local_id(1) * size.x + get_local_id(0);
+    int n = size.x * size.y;
+    int tiles_x = (w + size.x - 1) / size.x;
+    int items = queue_in ? (queue_in_count + n - 1) / n : tiles_x * ((h + size.y - 1) / size.y);
 
-    for(int i = 0; i < MYFLOAT_MANT_SIZE; ++i)
+    while(true)
     {
-        if(mF2.mant[MYFLOAT_MANT_SIZE - i - 1])
-        {
-            myFloat tmp = createMyFloat();
+        if(lid == 0)
+            item = atomic_inc(&counters[0]);
 
-            //COPYING THE MYFLOAT_MANT_SIZE - I DATA FROM THE MF2'S MANTISSA
-            for(int j = 0; j < MYFLOAT_MANT_SIZE - i - shift; ++j)
-                tmp.mant[j] = mF1.mant[j + i + shift];
+        barrier(CLK_LOCAL_MEM_FENCE);
+        int current = item;
+        barrier(CLK_LOCAL_MEM_FENCE);
 
-            //ADDING ZEROS TO THE TMP'S FRONT (BACK IN OUR STORING)
-            for(int j = 0; j < i + shift; ++j)
-                tmp.mant[MYFLOAT_MANT_SIZE - i + j] = 0;
-
-            tmp.exp = res.exp;
-            res = addUnsigned(res, tmp);
-            carry = (tmp.exp != res.exp);
-            shift += carry ? 1 : 0;
-        }
-    }
+        if(current >= items)
+            break;
 
-    res.exp = mF1.exp + mF2.exp + shift;
+        int2 coord;
+        number cr, ci, zr, zi;
+        int i = 0;
+        bool valid;
 
-    res.sign = exor(mF1.sign, mF2.sign);
+        if(queue_in)
+        {
+            int slot = current * n + lid;
+            valid = slot < queue_in_count;
+
+            if(valid)
+            {
+                orbit o = ((__global orbit *)queue_in)[slot];
+                coord = (int2)(o.index % w, o.index / w);
+                i = o.i;
+                zr = o.zr;
+                zi = o.zi;
+                pixelToConstant(coord, w, h, origin, zoom, julia, &cr, &ci);
+            }
+        }
+        else
+        {
+            coord = (int2)((current % tiles_x) * size.x + get_local_id(0), (current / tiles_x) * size.y + get_local_id(1));
+            valid = coord.x < w && coord.y < h;
 
-    return res;
-}
+            if(valid)
+                pixelToOrbit(coord, w, h, origin, zoom, julia, &cr, &ci, &zr, &zi);
+        }
 
-__kernel void mandelbrot(__global uchar4 *result, int w, int h, int max_iter, float2 origin, float zoom)
-{
-    int2 coord = { get_global_id(0), get_global_id(1) };
-    int index = coord.y * h + coord.x;
+        if(!valid)
+            continue;
 
-    myFloat cr = convertFromFloat((coord.x / (float)w) - 0.5);
-    myFloat ci = convertFromFloat((coord.y / (float)h) - 0.5);
+        int end = min(i + budget, max_iter);
+        int index = coord.y * pitch + coord.x;
 
-    cr = add(multiply(cr, convertFromFloat(zoom)), convertFromFloat(origin.x));
-    ci = add(multiply(ci, convertFromFloat(zoom)), convertFromFloat(origin.y));
+        i = iterateFrom(cr, ci, &zr, &zi, i, end);
 
-    myFloat zr = cr;
-    myFloat zi = ci;
+        if(i == end && end < max_iter)
+        {
+            orbit o = { coord.y * w + coord.x, i, zr, zi };
+            ((__global orbit *)queue_out)[atomic_inc(&counters[1])] = o;
+        }
+        else
+        {
+            result[index] = colorize(i, max_iter);
 
-    int i = 0;
-    for(i = 0; i < max_iter; ++i)
-    {
-        myFloat real = subtract(multiply(zr, zr), multiply(zi, zi));
-        zi = multiply(multiply(convertFromFloat(2), zr), zi);
-        zr = real;
-        zr = add(zr, cr);
-        zi = add(zi, ci);
-        
-        if(compare(add(multiply(zr, zr), multiply(zi, zi)), convertFromFloat(4)) == 1)
-            break;
+            if(iterations)
+                iterations[index] = i;
+        }
     }
-
-    float col = i == max_iter ? 0 : i / (float)max_iter;
-    float4 color = { col * (i / (255.0f * 255.0f)) * (1.0f / max_iter), col, col, 1.0f };
-    uchar4 output = convert_uchar4_sat_rte(color * 255.0f);
-    result[index] = output;
-}
+}
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <string.h>
+#include <stdarg.h>
+#include <math.h>
 #include <sys/stat.h>
 
 #include <OpenGL/OpenGL.h>
@@ -7,30 +9,63 @@
 #include <GLUT/glut.h>
 
 #include <mach/mach_time.h>
+#include <stdatomic.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 
 #define USE_GL_ATTACHMENTS              (1)
 #define DEBUG_INFO                      (0)     
+#define USE_INSTRUMENTATION             (0)
 #define COMPUTE_KERNEL_FILENAME         ("kernel.cl")
+#define MYFLOAT_HEADER_FILENAME         ("myfloat.h")
+#define PROGRAM_CACHE_SIZE              (8)
+#define FRACTAL_MIN_EXPONENT            (2)
+#define FRACTAL_MAX_EXPONENT            (8)
 #define COMPUTE_KERNEL_METHOD_NAME      ("mandelbrot")
+#define ANALYTICS_KERNEL_METHOD_NAME    ("mandelbrot_analytics")
+#define PERSISTENT_KERNEL_METHOD_NAME   ("mandelbrot_persistent")
+#define ORBIT_SIZE_KERNEL_METHOD_NAME   ("orbit_size")
+#define PERSISTENT_ITERATION_BUDGET     (32)
+#define PERSISTENT_GROUPS_PER_UNIT      (4)
+#define ANALYTICS_HEATMAP_FILENAME      ("heatmap.ppm")
+#define ANALYTICS_WORST_GROUPS          (10)
 #define SEPARATOR                       ("----------------------------------------------------------------------\n")
 #define WIDTH                           (512)
 #define HEIGHT                          (512)
+#define ROW_PITCH_ALIGNMENT             (32)    // PIXELS
+#define TRACE_RING_SIZE                 (8192)  // MUST BE A POWER OF TWO
+#define TRACE_PENDING_EVENTS            (16)    // INITIAL CAPACITY, GROWS AS NEEDED
+#define TRACE_FILENAME                  ("trace.json")
+#define BENCH_WARMUP_RUNS               (2)
+#define BENCH_MEASURED_RUNS             (20)    // AT LEAST 20 SO P95 IS NOT THE MAXIMUM
+#define BENCH_DEFAULT_OUTPUT            ("bench.json")
+#define BENCH_DEFAULT_THRESHOLD         (0.05)
 
 ////////////////////////////////////////////////////////////////////////////////
 
 static cl_context                       ComputeContext;
 static cl_command_queue                 ComputeCommands;
 static cl_kernel                        ComputeKernel;
+static cl_kernel                        AnalyticsKernel;
+static cl_kernel                        PersistentKernel;
 static cl_program                       ComputeProgram;
 static cl_device_id                     ComputeDeviceId;
 static cl_device_type                   ComputeDeviceType;
 static cl_mem                           ComputeResult;
 static cl_mem                           ComputeImage;
+static cl_mem                           PersistentCounters;
+static cl_mem                           PersistentQueues[2];
+static size_t                           PersistentQueueCapacity;
+static size_t                           PersistentOrbitSize;
+static cl_uint                          ComputeUnits;
 static size_t                           MaxWorkGroupSize;
 static int                              WorkGroupSize[2];
+static int                              PersistentWorkGroupSize[2];
 static int                              WorkGroupItems = 32;
+static int                              ProfilingEnabled = USE_INSTRUMENTATION;
+static int                              UsePersistentThreads = 0;
+static char                             ComputeBuildOptions[256] = "\0";
+static char                             ComputeDeviceName[2048] = "\0";
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -43,6 +78,77 @@ static int MaxIterations                = 50;
 static float Origin[2]                  = {-0.75, 0};
 static float Zoom                       = 3.0f;
 
+typedef enum
+{
+    FRACTAL_MANDELBROT,
+    FRACTAL_JULIA,
+    FRACTAL_BURNING_SHIP,
+    FRACTAL_TYPE_COUNT
+} FractalType;
+
+static const char *FractalNames[FRACTAL_TYPE_COUNT] = { "mandelbrot", "julia", "burningship" };
+
+static FractalType Fractal              = FRACTAL_MANDELBROT;
+static int FractalExponent              = 2;
+static float JuliaC[2]                  = {-0.8f, 0.156f};
+static char FractalSource[4096]         = "\0";
+
+typedef struct
+{
+    char *Formula;
+    char Options[256];
+    cl_program Program;
+} CachedProgram;
+
+static CachedProgram ProgramCache[PROGRAM_CACHE_SIZE];
+static int ProgramCacheNext             = 0;
+
+typedef struct
+{
+    float Zoom;
+    float Origin[2];
+} ScenePreset;
+
+static const ScenePreset Presets[]      = { { 3.0f,     { -0.75f,     0.0f      } },
+                                            { 0.000005f, { 0.241550f,  0.568976f } },
+                                            { 0.000009f, { 0.347425f,  -0.581360f } },
+                                            { 0.000005f, { -1.942068f, 0.000409f } },
+                                            { 0.000005f, { -0.786518f, 0.165409f } },
+                                            { 0.000005f, { -0.742016f, 0.245320f } } };
+
+#define PRESET_COUNT                    (sizeof(Presets) / sizeof(Presets[0]))
+
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    char Backend[8];
+    char NumberType[16];
+    char Kernel[16];
+    char Fractal[16];
+    char Device[256];
+    int Scene;
+    int Width;
+    int Height;
+    int MaxIterations;
+    double MedianMs;
+    double P95Ms;
+    double MPixelsPerSec;
+    double GIterationsPerSec;
+} BenchResult;
+
+static const int BenchSizes[]           = { 256, 512 };
+static const int BenchIterations[]      = { 50, 100 };
+static const char *BenchNumberTypes[][2] = { { "myFloat", "" },
+                                             { "float",   "-DNUMBER_TYPE_FLOAT" } };
+
+static const char *BenchKernels[]       = { "ndrange", "persistent" };
+
+#define BENCH_KERNEL_COUNT              (sizeof(BenchKernels) / sizeof(BenchKernels[0]))
+#define BENCH_SIZE_COUNT                (sizeof(BenchSizes) / sizeof(BenchSizes[0]))
+#define BENCH_ITERATION_COUNT           (sizeof(BenchIterations) / sizeof(BenchIterations[0]))
+#define BENCH_NUMBER_TYPE_COUNT         (sizeof(BenchNumberTypes) / sizeof(BenchNumberTypes[0]))
+
 ////////////////////////////////////////////////////////////////////////////////
 
 static uint TextureId                   = 0;
@@ -97,6 +203,187 @@ static double SubtractTime( uint64_t uiEndTime, uint64_t uiStartTime )
 
 ////////////////////////////////////////////////////////////////////////////////
 
+#if (USE_INSTRUMENTATION)
+
+typedef struct
+{
+    const char *Name;
+    const char *Category;
+    double Start;
+    double Duration;
+    int Thread;
+} TraceEvent;
+
+typedef struct
+{
+    const char *Name;
+    cl_event Event;
+    uint64_t Enqueued;
+} TracePendingEvent;
+
+enum { TRACE_THREAD_HOST = 1, TRACE_THREAD_DEVICE = 2 };
+
+static TraceEvent TraceRing[TRACE_RING_SIZE];
+static atomic_uint TraceHead;
+static uint64_t TraceEpoch;
+static TracePendingEvent *TracePending;
+static int TracePendingCount;
+static int TracePendingCapacity;
+static unsigned int TraceDroppedEvents;
+
+static double TraceTimestamp(uint64_t uiTime)
+{
+    if(!TraceEpoch)
+        TraceEpoch = uiTime;
+
+    return SubtractTime(uiTime, TraceEpoch) * 1e6;
+}
+
+static void TraceRecord(const char *name, const char *category, double start, double duration, int thread)
+{
+    // Single producer: fill the slot first, then publish it by advancing 
+    // the head, so a reader never sees a half written event
+    //
+    unsigned int head = atomic_load_explicit(&TraceHead, memory_order_relaxed);
+    TraceEvent *event = &TraceRing[head & (TRACE_RING_SIZE - 1)];
+
+    event->Name = name;
+    event->Category = category;
+    event->Start = start;
+    event->Duration = duration;
+    event->Thread = thread;
+
+    atomic_store_explicit(&TraceHead, head + 1, memory_order_release);
+}
+
+static void TraceHostEvent(const char *name, uint64_t uiStartTime, uint64_t uiEndTime)
+{
+    double start = TraceTimestamp(uiStartTime);
+    TraceRecord(name, "host", start, TraceTimestamp(uiEndTime) - start, TRACE_THREAD_HOST);
+}
+
+static cl_event *TraceDeviceEvent(const char *name)
+{
+    // A persistent frame registers one event per round, so slow frames need 
+    // the most room. The list grows instead of dropping them, the returned 
+    // pointer is only valid until the next call
+    //
+    if(TracePendingCount >= TracePendingCapacity)
+    {
+        int capacity = TracePendingCapacity ? 2 * TracePendingCapacity : TRACE_PENDING_EVENTS;
+        TracePendingEvent *pending = (TracePendingEvent*)realloc(TracePending, capacity * sizeof(TracePendingEvent));
+        if (!pending)
+        {
+            TraceDroppedEvents++;
+            return NULL;
+        }
+
+        TracePending = pending;
+        TracePendingCapacity = capacity;
+    }
+
+    TracePendingEvent *pending = &TracePending[TracePendingCount++];
+    pending->Name = name;
+    pending->Event = 0;
+    pending->Enqueued = GetCurrentTime();
+    return &pending->Event;
+}
+
+static void TraceResolveDeviceEvents(void)
+{
+    // Device timestamps are on the device clock, so each command is placed 
+    // on the host timeline relative to the moment it was enqueued
+    //
+    int i, kept = 0;
+    for(i = 0; i < TracePendingCount; i++)
+    {
+        TracePendingEvent *pending = &TracePending[i];
+        cl_int status = CL_COMPLETE;
+        cl_ulong queued = 0, start = 0, end = 0;
+
+        if(!pending->Event)
+            continue;
+
+        clGetEventInfo(pending->Event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, NULL);
+        if(status > CL_COMPLETE)
+        {
+            TracePending[kept++] = *pending;
+            continue;
+        }
+
+        if(status == CL_COMPLETE &&
+           clGetEventProfilingInfo(pending->Event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued, NULL) == CL_SUCCESS &&
+           clGetEventProfilingInfo(pending->Event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL) == CL_SUCCESS &&
+           clGetEventProfilingInfo(pending->Event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL) == CL_SUCCESS)
+        {
+            TraceRecord(pending->Name, "device", TraceTimestamp(pending->Enqueued) + (start - queued) * 1e-3, 
+                        (end - start) * 1e-3, TRACE_THREAD_DEVICE);
+        }
+
+        clReleaseEvent(pending->Event);
+    }
+
+    TracePendingCount = kept;
+}
+
+static void TraceReleaseDeviceEvents(void)
+{
+    int i;
+    for(i = 0; i < TracePendingCount; i++)
+        if(TracePending[i].Event)
+            clReleaseEvent(TracePending[i].Event);
+
+    free(TracePending);
+    TracePending = 0;
+    TracePendingCount = 0;
+    TracePendingCapacity = 0;
+}
+
+static int WriteTrace(const char *file_name)
+{
+    FILE *file = fopen(file_name, "w");
+    if (!file)
+    {
+        printf("Error opening file %s\n", file_name);
+        return -1;
+    }
+
+    unsigned int head = atomic_load_explicit(&TraceHead, memory_order_acquire);
+    unsigned int first = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+    unsigned int i;
+
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(file, "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"Host\"}},\n", TRACE_THREAD_HOST);
+    fprintf(file, "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"Device\"}}", TRACE_THREAD_DEVICE);
+
+    for(i = first; i != head; i++)
+    {
+        const TraceEvent *event = &TraceRing[i & (TRACE_RING_SIZE - 1)];
+        fprintf(file, ",\n  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d}",
+                event->Name, event->Category, event->Start, event->Duration, event->Thread);
+    }
+
+    fprintf(file, "\n], \"otherData\": {\"dropped_device_events\": %u}}\n", TraceDroppedEvents);
+    fclose(file);
+
+    printf("Wrote %u trace events to '%s' (%u device events dropped)\n", head - first, file_name, TraceDroppedEvents);
+    return CL_SUCCESS;
+}
+
+#define TRACE_BEGIN(stage)              uint64_t uiTrace_##stage = GetCurrentTime()
+#define TRACE_END(stage)                TraceHostEvent(#stage, uiTrace_##stage, GetCurrentTime())
+#define TRACE_CL_EVENT(name)            TraceDeviceEvent(name)
+
+#else
+
+#define TRACE_BEGIN(stage)
+#define TRACE_END(stage)
+#define TRACE_CL_EVENT(name)            NULL
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
 static int LoadTextFromFile(const char *file_name, char **result_string, size_t *string_len)
 {
     int fd;
@@ -139,6 +426,7 @@ static void CreateTexture(uint width, uint height)
         glDeleteTextures(1, &TextureId);
     TextureId = 0;
     
+    TRACE_BEGIN(CreateTexture);
     printf("Creating Texture %d x %d...\n", width, height);
 
     TextureWidth = width;
@@ -154,10 +442,12 @@ static void CreateTexture(uint width, uint height)
     glTexImage2D(TextureTarget, 0, TextureInternal, TextureWidth, TextureHeight, 0, 
                  TextureFormat, TextureType, 0);
     glBindTexture(TextureTarget, 0);
+    TRACE_END(CreateTexture);
 }
 
 static void RenderTexture( void *pvData )
 {
+    TRACE_BEGIN(RenderTexture);
     glDisable( GL_LIGHTING );
 
     glViewport( 0, 0, Width * 2, Height * 2 );
@@ -176,8 +466,17 @@ static void RenderTexture( void *pvData )
     glBindTexture( TextureTarget, TextureId );
 
     if(pvData)
-        glTexSubImage2D(TextureTarget, 0, 0, 0, TextureWidth, TextureHeight, 
+    {
+        TRACE_BEGIN(glTexSubImage2D);
+        glTexSubImage2D(TextureTarget, 0, 0, 0, TextureWidth, Height, 
                         TextureFormat, TextureType, pvData);
+        TRACE_END(glTexSubImage2D);
+    }
+
+    // The texture may be larger than the image, only its corner is shown
+    //
+    float u = Width / (float)TextureWidth;
+    float v = Height / (float)TextureHeight;
 
     glTexParameteri(TextureTarget, GL_TEXTURE_COMPARE_MODE_ARB, GL_NONE);
     glBegin( GL_QUADS );
@@ -186,39 +485,39 @@ static void RenderTexture( void *pvData )
         glTexCoord2f( 0.0f, 0.0f );
         glVertex3f( -1.0f, -1.0f, 0.0f );
 
-        glTexCoord2f( 0.0f, 1.0f );
+        glTexCoord2f( 0.0f, v );
         glVertex3f( -1.0f, 1.0f, 0.0f );
 
-        glTexCoord2f( 1.0f, 1.0f );
+        glTexCoord2f( u, v );
         glVertex3f( 1.0f, 1.0f, 0.0f );
 
-        glTexCoord2f( 1.0f, 0.0f );
+        glTexCoord2f( u, 0.0f );
         glVertex3f( 1.0f, -1.0f, 0.0f );
     }
     glEnd();
     glBindTexture( TextureTarget, 0 );
     glDisable( TextureTarget );
+    TRACE_END(RenderTexture);
 }
 
-static int Recompute(void)
+static int SetComputeKernelArgs(cl_mem result, cl_mem iterations, int width, int height, int pitch, 
+                                int max_iter, const float *origin, float zoom)
 {
-    if(!ComputeKernel || !ComputeResult)
-        return CL_SUCCESS;
-        
     void *values[10];
     size_t sizes[10];
-    size_t global[2];
-    size_t local[2];
 
-    int err = 0;
+    int err = CL_SUCCESS;
     unsigned int v = 0, s = 0, a = 0;
     
-    values[v++] = &ComputeResult;
-    values[v++] = &Width;
-    values[v++] = &Height;
-    values[v++] = &MaxIterations;
-    values[v++] = &Origin;
-    values[v++] = &Zoom;
+    values[v++] = &result;
+    values[v++] = &width;
+    values[v++] = &height;
+    values[v++] = &max_iter;
+    values[v++] = (void*)origin;
+    values[v++] = &zoom;
+    values[v++] = &iterations;
+    values[v++] = &pitch;
+    values[v++] = JuliaC;
 
     sizes[s++] = sizeof(cl_mem);
     sizes[s++] = sizeof(int);
@@ -226,23 +525,185 @@ static int Recompute(void)
     sizes[s++] = sizeof(int);
     sizes[s++] = (2 * sizeof(float));
     sizes[s++] = sizeof(float);
+    sizes[s++] = sizeof(cl_mem);
+    sizes[s++] = sizeof(int);
+    sizes[s++] = (2 * sizeof(float));
+
+    for (a = 0; a < s; a++)
+        err |= clSetKernelArg(ComputeKernel, a, sizes[a], values[a]);
+
+    return err;
+}
+
+static int RunPersistentKernel(cl_mem result, cl_mem iterations, int width, int height, int pitch, int max_iter, 
+                               const float *origin, float zoom, cl_event *first_event, cl_event *last_event)
+{
+    int err = CL_SUCCESS;
+    size_t capacity = (size_t)width * height;
+
+    if(!PersistentCounters)
+    {
+        PersistentCounters = clCreateBuffer(ComputeContext, CL_MEM_READ_WRITE, 2 * sizeof(cl_int), NULL, &err);
+        if (!PersistentCounters)
+        {
+            printf("Failed to create persistent work counters! %d\n", err);
+            return -1;
+        }
+    }
+
+    // In the worst case every pixel is still running after the first round
+    //
+    if(capacity > PersistentQueueCapacity)
+    {
+        int q;
+        for(q = 0; q < 2; q++)
+        {
+            if(PersistentQueues[q])
+                clReleaseMemObject(PersistentQueues[q]);
+
+            PersistentQueues[q] = clCreateBuffer(ComputeContext, CL_MEM_READ_WRITE, PersistentOrbitSize * capacity, NULL, &err);
+            if (!PersistentQueues[q])
+            {
+                printf("Failed to create persistent orbit queue! %d\n", err);
+                PersistentQueueCapacity = 0;
+                return -1;
+            }
+        }
+
+        PersistentQueueCapacity = capacity;
+    }
+
+    size_t global[2];
+    size_t local[2];
+
+    global[0] = ComputeUnits * PERSISTENT_GROUPS_PER_UNIT * PersistentWorkGroupSize[0];
+    global[1] = PersistentWorkGroupSize[1];
+    local[0] = PersistentWorkGroupSize[0];
+    local[1] = PersistentWorkGroupSize[1];
+
+    cl_int budget = PERSISTENT_ITERATION_BUDGET;
+    cl_int queue_in_count = 0;
+    cl_mem queue_in = 0;
+    cl_mem queue_out = PersistentQueues[0];
+
+    if(first_event)
+        *first_event = 0;
+    if(last_event)
+        *last_event = 0;
+
+    do
+    {
+        void *values[14];
+        size_t sizes[14];
+        unsigned int v = 0, a = 0;
+        cl_int counters[2] = { 0, 0 };
+        cl_event event = 0;
+
+        // Each value is listed with its size, in kernel signature order, so the 
+        // two cannot drift apart when arguments are added
+        //
+        values[v] = &result;                sizes[v++] = sizeof(cl_mem);
+        values[v] = &width;                 sizes[v++] = sizeof(int);
+        values[v] = &height;                sizes[v++] = sizeof(int);
+        values[v] = &max_iter;              sizes[v++] = sizeof(int);
+        values[v] = (void*)origin;          sizes[v++] = (2 * sizeof(float));
+        values[v] = &zoom;                  sizes[v++] = sizeof(float);
+        values[v] = &iterations;            sizes[v++] = sizeof(cl_mem);
+        values[v] = &PersistentCounters;    sizes[v++] = sizeof(cl_mem);
+        values[v] = &budget;                sizes[v++] = sizeof(int);
+        values[v] = &queue_in;              sizes[v++] = sizeof(cl_mem);
+        values[v] = &queue_in_count;        sizes[v++] = sizeof(int);
+        values[v] = &queue_out;             sizes[v++] = sizeof(cl_mem);
+        values[v] = &pitch;                 sizes[v++] = sizeof(int);
+        values[v] = JuliaC;                 sizes[v++] = (2 * sizeof(float));
+
+        for (a = 0; a < v; a++)
+            err |= clSetKernelArg(PersistentKernel, a, sizes[a], values[a]);
+
+        err |= clEnqueueWriteBuffer(ComputeCommands, PersistentCounters, CL_FALSE, 0, sizeof(counters), counters, 0, NULL, NULL);
+        if (err)
+        {
+            printf("Failed to prepare persistent kernel round! %d\n", err);
+            return err;
+        }
+
+        err = clEnqueueNDRangeKernel(ComputeCommands, PersistentKernel, 2, NULL, global, local, 0, NULL, 
+                                     (first_event || last_event) ? &event : TRACE_CL_EVENT(PERSISTENT_KERNEL_METHOD_NAME));
+        if (err)
+        {
+            printf("Failed to enqueue persistent kernel! %d\n", err);
+            return err;
+        }
+
+        if(event)
+        {
+            if(first_event && !*first_event)
+            {
+                clRetainEvent(event);
+                *first_event = event;
+            }
+
+            if(last_event)
+            {
+                if(*last_event)
+                    clReleaseEvent(*last_event);
+
+                clRetainEvent(event);
+                *last_event = event;
+            }
+
+            clReleaseEvent(event);
+        }
+
+        // The host has to see how many orbits are left before it can size the next round
+        //
+        err = clEnqueueReadBuffer(ComputeCommands, PersistentCounters, CL_TRUE, 0, sizeof(counters), counters, 0, NULL, NULL);
+        if (err)
+        {
+            printf("Failed to read persistent work counters! %d\n", err);
+            return err;
+        }
+
+        queue_in_count = counters[1];
+        queue_in = queue_out;
+        queue_out = (queue_out == PersistentQueues[0]) ? PersistentQueues[1] : PersistentQueues[0];
+    }
+    while(queue_in_count > 0);
+
+    return CL_SUCCESS;
+}
+
+static int Recompute(void)
+{
+    if(!ComputeKernel || !ComputeResult)
+        return CL_SUCCESS;
+        
+    size_t global[2];
+    size_t local[2];
+
+    int err = 0;
+
+    TRACE_BEGIN(Recompute);
 
     if(Update)
     {
+        TRACE_BEGIN(SetKernelArgs);
         Update = 0;
-        err = CL_SUCCESS;
-        for (a = 0; a < s; a++)
-            err |= clSetKernelArg(ComputeKernel, a, sizes[a], values[a]);
-    
+
+        // The render path records no iteration counts, only the benchmark 
+        // and the analytics kernel do
+        //
+        err = SetComputeKernelArgs(ComputeResult, NULL, Width, Height, TextureWidth, MaxIterations, Origin, Zoom);
         if (err)
             return -10;
+        TRACE_END(SetKernelArgs);
     }
     
     int size_x = WorkGroupSize[0];
     int size_y = WorkGroupSize[1];
     
-    global[0] = DivideUp(TextureWidth, size_x) * size_x; 
-    global[1] = DivideUp(TextureHeight, size_y) * size_y;
+    global[0] = DivideUp(Width, size_x) * size_x; 
+    global[1] = DivideUp(Height, size_y) * size_y;
     
     local[0] = size_x;
     local[1] = size_y;
@@ -254,51 +715,68 @@ static int Recompute(void)
             (int)local[0], (int)local[1]);
 #endif
 
-    err = clEnqueueNDRangeKernel(ComputeCommands, ComputeKernel, 2, NULL, global, local, 0, NULL, NULL);
+    TRACE_BEGIN(EnqueueKernel);
+    if(UsePersistentThreads)
+        err = RunPersistentKernel(ComputeResult, NULL, Width, Height, TextureWidth, MaxIterations, 
+                                  Origin, Zoom, NULL, NULL);
+    else
+        err = clEnqueueNDRangeKernel(ComputeCommands, ComputeKernel, 2, NULL, global, local, 0, NULL, 
+                                     TRACE_CL_EVENT(COMPUTE_KERNEL_METHOD_NAME));
     if (err)
     {
         printf("Failed to enqueue kernel! %d\n", err);
         return err;
     }
+    TRACE_END(EnqueueKernel);
 
 #if (USE_GL_ATTACHMENTS)
 
-    err = clEnqueueAcquireGLObjects(ComputeCommands, 1, &ComputeImage, 0, 0, 0);
+    TRACE_BEGIN(AcquireGLObjects);
+    err = clEnqueueAcquireGLObjects(ComputeCommands, 1, &ComputeImage, 0, 0, TRACE_CL_EVENT("AcquireGLObjects"));
     if (err != CL_SUCCESS)
     {
         printf("Failed to acquire GL object! %d\n", err);
         return EXIT_FAILURE;
     }
+    TRACE_END(AcquireGLObjects);
 
     size_t origin[] = { 0, 0, 0 };
-    size_t region[] = { TextureWidth, TextureHeight, 1 };
+    size_t region[] = { TextureWidth, Height, 1 };
+    TRACE_BEGIN(CopyBufferToImage);
     err = clEnqueueCopyBufferToImage(ComputeCommands, ComputeResult, ComputeImage, 
-                                     0, origin, region, 0, NULL, 0);
+                                     0, origin, region, 0, NULL, TRACE_CL_EVENT("CopyBufferToImage"));
     
     if(err != CL_SUCCESS)
     {
         printf("Failed to copy buffer to image! %d\n", err);
         return EXIT_FAILURE;
     }
+    TRACE_END(CopyBufferToImage);
     
-    err = clEnqueueReleaseGLObjects(ComputeCommands, 1, &ComputeImage, 0, 0, 0);
+    TRACE_BEGIN(ReleaseGLObjects);
+    err = clEnqueueReleaseGLObjects(ComputeCommands, 1, &ComputeImage, 0, 0, TRACE_CL_EVENT("ReleaseGLObjects"));
     if (err != CL_SUCCESS)
     {
         printf("Failed to release GL object! %d\n", err);
         return EXIT_FAILURE;
     }
+    TRACE_END(ReleaseGLObjects);
 
 #else
 
-    err = clEnqueueReadBuffer( ComputeCommands, ComputeResult, CL_TRUE, 0, Width * Height * TextureTypeSize * 4, HostImageBuffer, 0, NULL, NULL );      
+    TRACE_BEGIN(ReadBuffer);
+    err = clEnqueueReadBuffer( ComputeCommands, ComputeResult, CL_TRUE, 0, TextureWidth * Height * TextureTypeSize * 4, HostImageBuffer, 0, NULL, 
+                               TRACE_CL_EVENT("ReadBuffer") );      
     if (err != CL_SUCCESS)
     {
         printf("Failed to read buffer! %d\n", err);
         return EXIT_FAILURE;
     }
+    TRACE_END(ReadBuffer);
 
 #endif
 
+    TRACE_END(Recompute);
     return CL_SUCCESS;
 }
 
@@ -307,6 +785,7 @@ static int Recompute(void)
 static int CreateComputeResult(void)
 {
     int err = 0;
+    TRACE_BEGIN(CreateComputeResult);
         
 #if (USE_GL_ATTACHMENTS)
 
@@ -350,14 +829,45 @@ static int CreateComputeResult(void)
         return -1;
     }
 
+    TRACE_END(CreateComputeResult);
     return CL_SUCCESS;
 }
 
+static int ResizeCompute(int width, int height)
+{
+    uint pitch = DivideUp(width, ROW_PITCH_ALIGNMENT) * ROW_PITCH_ALIGNMENT;
+
+    Width = width;
+    Height = height;
+    Update = 1;
+
+    // The texture and buffers only ever grow, anything that fits is drawn 
+    // into the corner of what is already allocated
+    //
+    if(pitch <= TextureWidth && height <= TextureHeight)
+        return CL_SUCCESS;
+
+    if(ComputeCommands)
+        clFinish(ComputeCommands);
+
+#if (USE_GL_ATTACHMENTS)
+    if(ComputeImage)
+        clReleaseMemObject(ComputeImage);
+    ComputeImage = 0;
+#endif
+
+    CreateTexture(pitch > TextureWidth ? pitch : TextureWidth, 
+                  height > TextureHeight ? height : TextureHeight);
+
+    return CreateComputeResult();
+}
+
 static int SetupComputeDevices(int gpu)
 {
     int err;
 	size_t returned_size;
     ComputeDeviceType = gpu ? CL_DEVICE_TYPE_GPU : CL_DEVICE_TYPE_CPU;
+    TRACE_BEGIN(SetupComputeDevices);
 
 #if (USE_GL_ATTACHMENTS)
 
@@ -437,7 +947,8 @@ static int SetupComputeDevices(int gpu)
         
     // Create a command queue
     //
-    ComputeCommands = clCreateCommandQueue(ComputeContext, ComputeDeviceId, 0, &err);
+    cl_command_queue_properties queue_properties = ProfilingEnabled ? CL_QUEUE_PROFILING_ENABLE : 0;
+    ComputeCommands = clCreateCommandQueue(ComputeContext, ComputeDeviceId, queue_properties, &err);
     if (!ComputeCommands)
     {
         printf("Error: Failed to create a command queue!\n");
@@ -456,27 +967,182 @@ static int SetupComputeDevices(int gpu)
         return EXIT_FAILURE;
     }
 
+    snprintf(ComputeDeviceName, sizeof(ComputeDeviceName), "%s %s", vendor_name, device_name);
+
+    err = clGetDeviceInfo(ComputeDeviceId, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &ComputeUnits, NULL);
+    if (err != CL_SUCCESS)
+    {
+        printf("Error: Failed to retrieve device compute units!\n");
+        return EXIT_FAILURE;
+    }
+
     printf(SEPARATOR);
-    printf("Connecting to %s %s...\n", vendor_name, device_name);
+    printf("Connecting to %s...\n", ComputeDeviceName);
 
+    TRACE_END(SetupComputeDevices);
     return CL_SUCCESS;
 }
 
-static int SetupComputeKernel(void)
+static void AppendText(char *buffer, size_t size, const char *format, ...)
+{
+    size_t used = strlen(buffer);
+    va_list args;
+
+    va_start(args, format);
+    if(used < size)
+        vsnprintf(buffer + used, size - used, format, args);
+    va_end(args);
+}
+
+static void GenerateFractalSource(char *buffer, size_t size)
+{
+    int exponent = FractalExponent;
+    int top = 0;
+    int bit, p = 0;
+
+    buffer[0] = '\0';
+    AppendText(buffer, size, "//GENERATED FOR %s, Z^%d + C\n", FractalNames[Fractal], exponent);
+
+    // Only whether c is the pixel is compiled in, the Julia c itself is a 
+    // kernel argument so changing it needs no rebuild
+    //
+    AppendText(buffer, size, "#define FRACTAL_JULIA %d\n", Fractal == FRACTAL_JULIA);
+
+    AppendText(buffer, size, "#define FRACTAL_STEP(zr, zi, cr, ci) \\\n{ \\\n");
+
+    // Burning Ship folds both components into the first quadrant before 
+    // raising the power
+    //
+    if(Fractal == FRACTAL_BURNING_SHIP)
+        AppendText(buffer, size, "    number p0r = numAbs(zr), p0i = numAbs(zi); \\\n");
+    else
+        AppendText(buffer, size, "    number p0r = zr, p0i = zi; \\\n");
+
+    // Left to right binary exponentiation, fully unrolled: square for every 
+    // bit below the top one and multiply by the base for every set bit. The 
+    // imaginary part of a square is doubled with an add, which is far cheaper 
+    // than a multiply for myFloat
+    //
+    while(exponent >> (top + 1))
+        top++;
+
+    for(bit = top - 1; bit >= 0; bit--)
+    {
+        AppendText(buffer, size, "    number t%d = numMultiply(p%dr, p%di); \\\n", p + 1, p, p);
+        AppendText(buffer, size, "    number p%dr = numSubtract(numMultiply(p%dr, p%dr), numMultiply(p%di, p%di)); \\\n", 
+                   p + 1, p, p, p, p);
+        AppendText(buffer, size, "    number p%di = numAdd(t%d, t%d); \\\n", p + 1, p + 1, p + 1);
+        p++;
+
+        if(exponent & (1 << bit))
+        {
+            AppendText(buffer, size, "    number p%dr = numSubtract(numMultiply(p%dr, p0r), numMultiply(p%di, p0i)); \\\n", 
+                       p + 1, p, p);
+            AppendText(buffer, size, "    number p%di = numAdd(numMultiply(p%dr, p0i), numMultiply(p%di, p0r)); \\\n", 
+                       p + 1, p, p);
+            p++;
+        }
+    }
+
+    AppendText(buffer, size, "    zr = numAdd(p%dr, cr); \\\n", p);
+    AppendText(buffer, size, "    zi = numAdd(p%di, ci); \\\n", p);
+    AppendText(buffer, size, "}\n");
+}
+
+static cl_program FindCachedProgram(const char *formula, const char *options)
+{
+    int i;
+    for(i = 0; i < PROGRAM_CACHE_SIZE; i++)
+    {
+        if(ProgramCache[i].Program && !strcmp(ProgramCache[i].Formula, formula) && 
+           !strcmp(ProgramCache[i].Options, options))
+            return ProgramCache[i].Program;
+    }
+
+    return 0;
+}
+
+static void CacheProgram(const char *formula, const char *options, cl_program program)
+{
+    // Round robin, the cache owns its programs and evicts the oldest one
+    //
+    CachedProgram *entry = &ProgramCache[ProgramCacheNext];
+    ProgramCacheNext = (ProgramCacheNext + 1) % PROGRAM_CACHE_SIZE;
+
+    if(entry->Program)
+        clReleaseProgram(entry->Program);
+    free(entry->Formula);
+
+    entry->Formula = strdup(formula);
+    strncpy(entry->Options, options, sizeof(entry->Options) - 1);
+    entry->Options[sizeof(entry->Options) - 1] = '\0';
+    entry->Program = program;
+}
+
+static void ReleaseProgramCache(void)
+{
+    int i;
+    for(i = 0; i < PROGRAM_CACHE_SIZE; i++)
+    {
+        if(ProgramCache[i].Program)
+            clReleaseProgram(ProgramCache[i].Program);
+        free(ProgramCache[i].Formula);
+
+        ProgramCache[i].Program = 0;
+        ProgramCache[i].Formula = 0;
+    }
+
+    ProgramCacheNext = 0;
+}
+
+static int QueryOrbitSize(void)
+{
+    int err = CL_SUCCESS;
+    cl_int size = 0;
+    size_t one = 1;
+
+    // The continuation queues hold device side structs, whose layout only 
+    // the kernel compiler knows
+    //
+    cl_kernel kernel = clCreateKernel(ComputeProgram, ORBIT_SIZE_KERNEL_METHOD_NAME, &err);
+    cl_mem buffer = clCreateBuffer(ComputeContext, CL_MEM_WRITE_ONLY, sizeof(cl_int), NULL, &err);
+    if (!kernel || !buffer)
+    {
+        err = -1;
+    }
+    else
+    {
+        err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &buffer);
+        err |= clEnqueueNDRangeKernel(ComputeCommands, kernel, 1, NULL, &one, &one, 0, NULL, NULL);
+        err |= clEnqueueReadBuffer(ComputeCommands, buffer, CL_TRUE, 0, sizeof(cl_int), &size, 0, NULL, NULL);
+    }
+
+    if(kernel)
+        clReleaseKernel(kernel);
+    if(buffer)
+        clReleaseMemObject(buffer);
+
+    PersistentOrbitSize = size;
+    return (err == CL_SUCCESS && size > 0) ? CL_SUCCESS : -1;
+}
+
+static int BuildComputeProgram(void)
 {
     int err = 0;
+    char *header = 0;
     char *source = 0;
     size_t length = 0;
+    cl_program program = 0;
 
-    if(ComputeKernel)
-        clReleaseKernel(ComputeKernel);    
-    ComputeKernel = 0;
-
-    if(ComputeProgram)
-        clReleaseProgram(ComputeProgram);
-    ComputeProgram = 0;
-    
     printf(SEPARATOR);
+    printf("Loading number header from file '%s'...\n", MYFLOAT_HEADER_FILENAME);
+    err = LoadTextFromFile(MYFLOAT_HEADER_FILENAME, &header, &length);
+    if (!header || err)
+    {
+        printf("Error: Failed to load number header!\n");
+        return EXIT_FAILURE;
+    }
+
     printf("Loading kernel source from file '%s'...\n", COMPUTE_KERNEL_FILENAME);    
     err = LoadTextFromFile(COMPUTE_KERNEL_FILENAME, &source, &length);
     if (!source || err)
@@ -489,78 +1155,213 @@ static int SetupComputeKernel(void)
     printf("%s\n", source);
 #endif
 
-    // Create the compute program from the source buffer
+    // Create the compute program from the header, the generated formula and 
+    // the source buffers, in that order so the kernel can use both without an 
+    // include path
     //
-    ComputeProgram = clCreateProgramWithSource(ComputeContext, 1, (const char **) &source, NULL, &err);
-    if (!ComputeProgram || err != CL_SUCCESS)
+    const char *sources[] = { header, FractalSource, source };
+    program = clCreateProgramWithSource(ComputeContext, 3, sources, NULL, &err);
+    if (!program || err != CL_SUCCESS)
     {
         printf("Error: Failed to create compute program!\n");
         return EXIT_FAILURE;
     }
+    free(header);
     free(source);
 
     // Build the program executable
     //
-    err = clBuildProgram(ComputeProgram, 0, NULL, NULL, NULL, NULL);
+    TRACE_BEGIN(clBuildProgram);
+    err = clBuildProgram(program, 0, NULL, ComputeBuildOptions, NULL, NULL);
     if (err != CL_SUCCESS)
     {
         size_t len;
         char buffer[2048];
 
         printf("Error: Failed to build program executable!\n");
-        clGetProgramBuildInfo(ComputeProgram, ComputeDeviceId, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, &len);
+        clGetProgramBuildInfo(program, ComputeDeviceId, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, &len);
         printf("%s\n", buffer);
+        clReleaseProgram(program);
         return EXIT_FAILURE;
     }
+    TRACE_END(clBuildProgram);
 
-    // Create the compute kernel from within the program
-    //
-    printf("Creating kernel '%s'...\n", COMPUTE_KERNEL_METHOD_NAME);    
-    ComputeKernel = clCreateKernel(ComputeProgram, COMPUTE_KERNEL_METHOD_NAME, &err);
-    if (!ComputeKernel || err != CL_SUCCESS)
-    {
-        printf("Error: Failed to create compute kernel!\n");
-        return EXIT_FAILURE;
-    }
+    CacheProgram(FractalSource, ComputeBuildOptions, program);
+    ComputeProgram = program;
 
-    // Get the maximum work group size for executing the kernel on the device
-    //
-    err = clGetKernelWorkGroupInfo(ComputeKernel, ComputeDeviceId, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &MaxWorkGroupSize, NULL);
+    return CL_SUCCESS;
+}
+
+static int QueryWorkGroupSize(cl_kernel kernel, size_t *max_size, int *size)
+{
+    int err = clGetKernelWorkGroupInfo(kernel, ComputeDeviceId, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), max_size, NULL);
     if (err != CL_SUCCESS)
-    {
-        printf("Error: Failed to retrieve kernel work group info! %d\n", err);
-        exit(1);
-    }
+        return err;
+
+    size[0] = (*max_size > 1) ? (*max_size / WorkGroupItems) : *max_size;
+    if(size[0] < 1)
+        size[0] = 1;
+    size[1] = *max_size / size[0];
+
+    return CL_SUCCESS;
+}
+
+static int SetupComputeKernel(void)
+{
+    int err = 0;
+    TRACE_BEGIN(SetupComputeKernel);
+
+    if(ComputeKernel)
+        clReleaseKernel(ComputeKernel);    
+    ComputeKernel = 0;
+
+    if(AnalyticsKernel)
+        clReleaseKernel(AnalyticsKernel);    
+    AnalyticsKernel = 0;
+
+    if(PersistentKernel)
+        clReleaseKernel(PersistentKernel);    
+    PersistentKernel = 0;
+
+    // The orbit layout depends on the number type, so the queues are rebuilt too
+    //
+    if(PersistentQueues[0])
+        clReleaseMemObject(PersistentQueues[0]);
+    if(PersistentQueues[1])
+        clReleaseMemObject(PersistentQueues[1]);
+    PersistentQueues[0] = PersistentQueues[1] = 0;
+    PersistentQueueCapacity = 0;
+
+    // Programs belong to the cache, which releases them
+    //
+    ComputeProgram = 0;
+
+    GenerateFractalSource(FractalSource, sizeof(FractalSource));
+
+#if (DEBUG_INFO)
+    printf("%s\n", FractalSource);
+#endif
+
+    ComputeProgram = FindCachedProgram(FractalSource, ComputeBuildOptions);
+    if(ComputeProgram)
+    {
+        printf(SEPARATOR);
+        printf("Using cached program for %s z^%d...\n", FractalNames[Fractal], FractalExponent);
+    }
+    else
+    {
+        err = BuildComputeProgram();
+        if (err != CL_SUCCESS)
+            return err;
+    }
+
+    // Create the compute kernel from within the program
+    //
+    printf("Creating kernel '%s'...\n", COMPUTE_KERNEL_METHOD_NAME);    
+    ComputeKernel = clCreateKernel(ComputeProgram, COMPUTE_KERNEL_METHOD_NAME, &err);
+    if (!ComputeKernel || err != CL_SUCCESS)
+    {
+        printf("Error: Failed to create compute kernel!\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Creating kernel '%s'...\n", ANALYTICS_KERNEL_METHOD_NAME);    
+    AnalyticsKernel = clCreateKernel(ComputeProgram, ANALYTICS_KERNEL_METHOD_NAME, &err);
+    if (!AnalyticsKernel || err != CL_SUCCESS)
+    {
+        printf("Error: Failed to create analytics kernel!\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Creating kernel '%s'...\n", PERSISTENT_KERNEL_METHOD_NAME);    
+    PersistentKernel = clCreateKernel(ComputeProgram, PERSISTENT_KERNEL_METHOD_NAME, &err);
+    if (!PersistentKernel || err != CL_SUCCESS)
+    {
+        printf("Error: Failed to create persistent kernel!\n");
+        return EXIT_FAILURE;
+    }
+
+    err = QueryOrbitSize();
+    if (err != CL_SUCCESS)
+    {
+        printf("Error: Failed to query orbit size! %d\n", err);
+        return EXIT_FAILURE;
+    }
+
+    // Get the maximum work group size for executing the kernel on the device
+    //
+    err = QueryWorkGroupSize(ComputeKernel, &MaxWorkGroupSize, WorkGroupSize);
+    if (err != CL_SUCCESS)
+    {
+        printf("Error: Failed to retrieve kernel work group info! %d\n", err);
+        exit(1);
+    }
+
+    // The persistent kernel keeps more private state and often has a lower 
+    // limit, so it gets its own size rather than capping the render kernel
+    //
+    size_t max_persistent_size = 0;
+    err = QueryWorkGroupSize(PersistentKernel, &max_persistent_size, PersistentWorkGroupSize);
+    if (err != CL_SUCCESS)
+    {
+        printf("Error: Failed to retrieve persistent kernel work group info! %d\n", err);
+        exit(1);
+    }
 
 #if (DEBUG_INFO)
     printf("MaxWorkGroupSize: %d\n", MaxWorkGroupSize);
     printf("WorkGroupItems: %d\n", WorkGroupItems);
+    printf("PersistentWorkGroupSize: %d x %d\n", PersistentWorkGroupSize[0], PersistentWorkGroupSize[1]);
 #endif
 
-    WorkGroupSize[0] = (MaxWorkGroupSize > 1) ? (MaxWorkGroupSize / WorkGroupItems) : MaxWorkGroupSize;
-    WorkGroupSize[1] = MaxWorkGroupSize / WorkGroupSize[0];
-
     printf(SEPARATOR);
 
+    TRACE_END(SetupComputeKernel);
     return CL_SUCCESS;
 
 }
 
 static void Cleanup(void)
 {
-    clFinish(ComputeCommands);
-    clReleaseKernel(ComputeKernel);
-    clReleaseProgram(ComputeProgram);
-    clReleaseCommandQueue(ComputeCommands);
-    clReleaseMemObject(ComputeResult);
-    clReleaseMemObject(ComputeImage);
-    clReleaseContext(ComputeContext);
+    if(ComputeCommands)
+        clFinish(ComputeCommands);
+
+#if (USE_INSTRUMENTATION)
+    TraceReleaseDeviceEvents();
+#endif
+
+    if(ComputeKernel)
+        clReleaseKernel(ComputeKernel);
+    if(AnalyticsKernel)
+        clReleaseKernel(AnalyticsKernel);
+    if(PersistentKernel)
+        clReleaseKernel(PersistentKernel);
+    ReleaseProgramCache();
+    if(ComputeCommands)
+        clReleaseCommandQueue(ComputeCommands);
+    if(ComputeResult)
+        clReleaseMemObject(ComputeResult);
+    if(ComputeImage)
+        clReleaseMemObject(ComputeImage);
+    if(PersistentCounters)
+        clReleaseMemObject(PersistentCounters);
+    if(PersistentQueues[0])
+        clReleaseMemObject(PersistentQueues[0]);
+    if(PersistentQueues[1])
+        clReleaseMemObject(PersistentQueues[1]);
+    if(ComputeContext)
+        clReleaseContext(ComputeContext);
     
     ComputeCommands = 0;
     ComputeKernel = 0;
+    AnalyticsKernel = 0;
+    PersistentKernel = 0;
     ComputeProgram = 0;    
     ComputeResult = 0;
     ComputeImage = 0;
+    PersistentCounters = 0;
+    PersistentQueues[0] = PersistentQueues[1] = 0;
+    PersistentQueueCapacity = 0;
     ComputeContext = 0;
 }
 
@@ -576,7 +1377,7 @@ static void Shutdown(void)
 
 static int SetupGraphics(void)
 {
-    CreateTexture(Width, Height);
+    CreateTexture(DivideUp(Width, ROW_PITCH_ALIGNMENT) * ROW_PITCH_ALIGNMENT, Height);
 
     glClearColor (0.0, 0.0, 0.0, 0.0);
 
@@ -651,6 +1452,212 @@ static int Initialize(int gpu)
     return CL_SUCCESS;
 }
 
+static void HeatmapColor(float t, unsigned char *rgb)
+{
+    // Black -> red -> yellow -> white
+    //
+    float r = t * 3.0f;
+    float g = t * 3.0f - 1.0f;
+    float b = t * 3.0f - 2.0f;
+
+    rgb[0] = (unsigned char)(255.0f * (r < 0.0f ? 0.0f : (r > 1.0f ? 1.0f : r)));
+    rgb[1] = (unsigned char)(255.0f * (g < 0.0f ? 0.0f : (g > 1.0f ? 1.0f : g)));
+    rgb[2] = (unsigned char)(255.0f * (b < 0.0f ? 0.0f : (b > 1.0f ? 1.0f : b)));
+}
+
+static int WriteHeatmap(const char *file_name, const cl_int *iterations, int width, int height, int max_iter)
+{
+    FILE *file = fopen(file_name, "wb");
+    if (!file)
+    {
+        printf("Error opening file %s\n", file_name);
+        return -1;
+    }
+
+    // Log scale, otherwise the few pixels near the boundary drown out the rest
+    //
+    double scale = 1.0 / log(1.0 + max_iter);
+    unsigned char rgb[3];
+    int x, y;
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for(y = height - 1; y >= 0; y--)
+    {
+        for(x = 0; x < width; x++)
+        {
+            HeatmapColor(log(1.0 + iterations[y * width + x]) * scale, rgb);
+            fwrite(rgb, 1, sizeof(rgb), file);
+        }
+    }
+
+    fclose(file);
+
+    printf("Wrote %d x %d iteration heatmap to '%s'\n", width, height, file_name);
+    return CL_SUCCESS;
+}
+
+static const cl_int *SortedGroups;
+
+static int CompareGroupDivergence(const void *a, const void *b)
+{
+    const cl_int *ga = &SortedGroups[4 * *(const int*)a];
+    const cl_int *gb = &SortedGroups[4 * *(const int*)b];
+    return (gb[2] > ga[2]) - (gb[2] < ga[2]);
+}
+
+static void ReportAnalytics(const cl_int *groups, int groups_x, int groups_y)
+{
+    int count = groups_x * groups_y;
+    int size = WorkGroupSize[0] * WorkGroupSize[1];
+    double total = 0, lanes = 0, padding = 0, pixels = 0;
+    int i;
+
+    int *order = (int*)malloc(count * sizeof(int));
+    if (!order)
+    {
+        printf("Failed to allocate analytics summary!\n");
+        return;
+    }
+
+    // Every item in a work-group is held until its slowest pixel is done, 
+    // so MAX * SIZE is the work the group was charged for. Padding items in 
+    // the edge groups are part of that and count as waste
+    //
+    for(i = 0; i < count; i++)
+    {
+        const cl_int *g = &groups[4 * i];
+        total += g[0];
+        lanes += (double)g[1] * size;
+        padding += (double)g[1] * (size - g[3]);
+        pixels += g[3];
+        order[i] = i;
+    }
+
+    SortedGroups = groups;
+    qsort(order, count, sizeof(int), CompareGroupDivergence);
+
+    printf(SEPARATOR);
+    printf("Work-groups: %d x %d of %d x %d items\n", groups_x, groups_y, WorkGroupSize[0], WorkGroupSize[1]);
+    printf("Iterations: %.0f total, %.2f mean per pixel\n", total, pixels ? total / pixels : 0.0);
+    printf("Wasted lanes: %.2f%% (%.2f%% in padding items)\n", 
+           lanes ? 100.0 * (lanes - total) / lanes : 0.0, lanes ? 100.0 * padding / lanes : 0.0);
+    printf("Worst work-groups by divergence (max - mean):\n");
+
+    for(i = 0; i < count && i < ANALYTICS_WORST_GROUPS; i++)
+    {
+        const cl_int *g = &groups[4 * order[i]];
+        printf("  group (%3d, %3d): max %6d mean %9.2f divergence %6d pixels %5d\n",
+               order[i] % groups_x, order[i] / groups_x, g[1], (double)g[0] / g[3], g[2], g[3]);
+    }
+
+    printf(SEPARATOR);
+    free(order);
+}
+
+static int RunAnalytics(void)
+{
+    int err = CL_SUCCESS;
+    size_t global[2];
+    size_t local[2];
+    size_t max_group_size = 0;
+
+    if(!AnalyticsKernel)
+        return CL_SUCCESS;
+
+    err = clGetKernelWorkGroupInfo(AnalyticsKernel, ComputeDeviceId, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &max_group_size, NULL);
+    if (err != CL_SUCCESS || max_group_size < (size_t)(WorkGroupSize[0] * WorkGroupSize[1]))
+    {
+        printf("Analytics kernel does not support %d x %d work-groups!\n", WorkGroupSize[0], WorkGroupSize[1]);
+        return -1;
+    }
+
+    int width = Width;
+    int height = Height;
+    int groups_x = DivideUp(width, WorkGroupSize[0]);
+    int groups_y = DivideUp(height, WorkGroupSize[1]);
+    size_t pixel_count = (size_t)width * height;
+    size_t group_count = (size_t)groups_x * groups_y;
+
+    cl_mem iterations = clCreateBuffer(ComputeContext, CL_MEM_WRITE_ONLY, sizeof(cl_int) * pixel_count, NULL, &err);
+    cl_mem groups = clCreateBuffer(ComputeContext, CL_MEM_WRITE_ONLY, 4 * sizeof(cl_int) * group_count, NULL, &err);
+    cl_int *host_iterations = (cl_int*)malloc(sizeof(cl_int) * pixel_count);
+    cl_int *host_groups = (cl_int*)malloc(4 * sizeof(cl_int) * group_count);
+    if (!iterations || !groups || !host_iterations || !host_groups)
+    {
+        printf("Failed to allocate analytics buffers!\n");
+        err = CL_OUT_OF_HOST_MEMORY;
+        goto cleanup;
+    }
+
+    void *values[10];
+    size_t sizes[10];
+    unsigned int v = 0, s = 0, a = 0;
+
+    values[v++] = &iterations;
+    values[v++] = &groups;
+    values[v++] = NULL;
+    values[v++] = &width;
+    values[v++] = &height;
+    values[v++] = &MaxIterations;
+    values[v++] = &Origin;
+    values[v++] = &Zoom;
+    values[v++] = JuliaC;
+
+    sizes[s++] = sizeof(cl_mem);
+    sizes[s++] = sizeof(cl_mem);
+    sizes[s++] = 2 * sizeof(cl_int) * WorkGroupSize[0] * WorkGroupSize[1];
+    sizes[s++] = sizeof(int);
+    sizes[s++] = sizeof(int);
+    sizes[s++] = sizeof(int);
+    sizes[s++] = (2 * sizeof(float));
+    sizes[s++] = sizeof(float);
+    sizes[s++] = (2 * sizeof(float));
+
+    for (a = 0; a < s; a++)
+        err |= clSetKernelArg(AnalyticsKernel, a, sizes[a], values[a]);
+
+    if (err)
+    {
+        printf("Failed to set analytics kernel arguments! %d\n", err);
+        goto cleanup;
+    }
+
+    global[0] = groups_x * WorkGroupSize[0];
+    global[1] = groups_y * WorkGroupSize[1];
+    local[0] = WorkGroupSize[0];
+    local[1] = WorkGroupSize[1];
+
+    err = clEnqueueNDRangeKernel(ComputeCommands, AnalyticsKernel, 2, NULL, global, local, 0, NULL, NULL);
+    if (err)
+    {
+        printf("Failed to enqueue analytics kernel! %d\n", err);
+        goto cleanup;
+    }
+
+    err = clEnqueueReadBuffer(ComputeCommands, iterations, CL_TRUE, 0, sizeof(cl_int) * pixel_count, host_iterations, 0, NULL, NULL);
+    err |= clEnqueueReadBuffer(ComputeCommands, groups, CL_TRUE, 0, 4 * sizeof(cl_int) * group_count, host_groups, 0, NULL, NULL);
+    if (err)
+    {
+        printf("Failed to read analytics results! %d\n", err);
+        goto cleanup;
+    }
+
+    ReportAnalytics(host_groups, groups_x, groups_y);
+    err = WriteHeatmap(ANALYTICS_HEATMAP_FILENAME, host_iterations, width, height, MaxIterations);
+
+cleanup:
+    if(iterations)
+        clReleaseMemObject(iterations);
+    if(groups)
+        clReleaseMemObject(groups);
+    free(host_iterations);
+    free(host_groups);
+
+    return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 static void ReportStats(uint64_t uiStartTime, uint64_t uiEndTime)
 {
     TimeElapsed += SubtractTime(uiEndTime, uiStartTime);
@@ -660,9 +1667,10 @@ static void ReportStats(uint64_t uiStartTime, uint64_t uiEndTime)
         double fMs = (TimeElapsed * 1000.0 / (double) FrameCount);
         double fFps = 1.0 / (fMs / 1000.0);
         
-        sprintf(StatsString, "[%s] Compute: %3.2f ms Display: %3.2f fps (%s) Zoom: %f Position: (%f, %f)\n", 
+        sprintf(StatsString, "[%s] Compute: %3.2f ms Display: %3.2f fps (%s, %s) %s z^%d Zoom: %f Position: (%f, %f)\n", 
                 (ComputeDeviceType == CL_DEVICE_TYPE_GPU) ? "GPU" : "CPU", 
-                fMs, fFps, USE_GL_ATTACHMENTS ? "attached" : "copying", Zoom, Origin[0], Origin[1]);
+                fMs, fFps, USE_GL_ATTACHMENTS ? "attached" : "copying", UsePersistentThreads ? "persistent" : "ndrange",
+                FractalNames[Fractal], FractalExponent, Zoom, Origin[0], Origin[1]);
 		
 		glutSetWindowTitle(StatsString);
 
@@ -675,6 +1683,10 @@ static void Display(void)
 {
     FrameCount++;
     uint64_t uiStartTime = GetCurrentTime();
+
+#if (USE_INSTRUMENTATION)
+    TraceResolveDeviceEvents();
+#endif
     
     glClearColor (0.0, 0.0, 0.0, 0.0);
     glClear (GL_COLOR_BUFFER_BIT);
@@ -688,13 +1700,56 @@ static void Display(void)
 
     RenderTexture(HostImageBuffer);
     
+    TRACE_BEGIN(glFinish);
     glFinish(); // for timing
+    TRACE_END(glFinish);
     
     uint64_t uiEndTime = GetCurrentTime();
+#if (USE_INSTRUMENTATION)
+    TraceHostEvent("Frame", uiStartTime, uiEndTime);
+#endif
     ReportStats(uiStartTime, uiEndTime);
     glutSwapBuffers();
 }
 
+static void SelectFractal(unsigned char key)
+{
+    switch( key )
+    {
+        case 'm':
+            Fractal = FRACTAL_MANDELBROT;
+            break;
+
+        case 'j':
+            Fractal = FRACTAL_JULIA;
+            break;
+
+        case 'b':
+            Fractal = FRACTAL_BURNING_SHIP;
+            break;
+
+        case '+':
+            if(FractalExponent < FRACTAL_MAX_EXPONENT)
+                FractalExponent++;
+            break;
+
+        case '-':
+            if(FractalExponent > FRACTAL_MIN_EXPONENT)
+                FractalExponent--;
+            break;
+    }
+
+    // Only the first selection of a formula compiles, later ones come from 
+    // the program cache
+    //
+    int err = SetupComputeKernel();
+    if (err != CL_SUCCESS)
+    {
+        printf("Failed to setup compute kernel! Error %d\n", err);
+        exit(1);
+    }
+}
+
 void Keyboard(unsigned char key, int x, int y)
 {
     const float move_speed = 0.05f;
@@ -731,43 +1786,49 @@ void Keyboard(unsigned char key, int x, int y)
             break;
 
         case '0':
-            Zoom = 3;
-            Origin[0] = -0.75;
-            Origin[1] = 0;
+        case '1':
+        case '2':
+        case '3':
+        case '4':
+        case '5':
+            Zoom = Presets[key - '0'].Zoom;
+            Origin[0] = Presets[key - '0'].Origin[0];
+            Origin[1] = Presets[key - '0'].Origin[1];
             break;
 
-        case '1':
-            Zoom = 0.000005;
-            Origin[0] = 0.241550;
-            Origin[1] = 0.568976;
+        case 'f':
+            glutFullScreen(); 
             break;
 
-        case '2':
-            Zoom = 0.000009;
-            Origin[0] = 0.347425;
-            Origin[1] = -0.581360;
+        case 'h':
+            RunAnalytics();
             break;
-        
-        case '3':
-            Zoom = 0.000005;
-            Origin[0] = -1.942068;
-            Origin[1] = 0.000409;
+
+        case 'p':
+            UsePersistentThreads = !UsePersistentThreads;
             break;
 
-        case '4':
-            Zoom = 0.000005;
-            Origin[0] = -0.786518;
-            Origin[1] = 0.165409;
+#if (USE_INSTRUMENTATION)
+        case 't':
+            WriteTrace(TRACE_FILENAME);
             break;
-        
-        case '5':
-            Zoom = 0.000005;
-            Origin[0] = -0.742016;
-            Origin[1] = 0.245320;
+#endif
+
+        case 'm':
+        case 'j':
+        case 'b':
+        case '+':
+        case '-':
+            SelectFractal(key);
             break;
 
-        case 'f':
-            glutFullScreen(); 
+        // The Julia c is a kernel argument, so picking a new one is free: 
+        // browse the Mandelbrot set, press c on an interesting point, then j
+        //
+        case 'c':
+            JuliaC[0] = Origin[0];
+            JuliaC[1] = Origin[1];
+            printf("Julia c = %f %+fi\n", JuliaC[0], JuliaC[1]);
             break;
 
     }
@@ -776,27 +1837,430 @@ void Keyboard(unsigned char key, int x, int y)
     glutPostRedisplay();
 }
 
+void Reshape(int width, int height)
+{
+    if(width <= 0 || height <= 0)
+        return;
+
+    int err = ResizeCompute(width, height);
+    if (err != CL_SUCCESS)
+    {
+        printf("Failed to resize compute result! Error %d\n", err);
+        exit(1);
+    }
+
+    glutPostRedisplay();
+}
+
 void Idle(void)
 {
     glutPostRedisplay();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+static int CompareDoubles(const void *a, const void *b)
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+static int BenchmarkScene(int persistent, int scene, int width, int height, int max_iter, BenchResult *result)
+{
+    int err = CL_SUCCESS;
+    size_t global[2];
+    size_t local[2];
+    double times[BENCH_MEASURED_RUNS];
+    size_t count = (size_t)width * height;
+
+    cl_mem output = clCreateBuffer(ComputeContext, CL_MEM_WRITE_ONLY, TextureTypeSize * 4 * count, NULL, &err);
+    cl_mem iterations = clCreateBuffer(ComputeContext, CL_MEM_WRITE_ONLY, sizeof(cl_int) * count, NULL, &err);
+    cl_int *host_iterations = (cl_int*)malloc(sizeof(cl_int) * count);
+    if (!output || !iterations || !host_iterations)
+    {
+        printf("Failed to allocate benchmark buffers!\n");
+        err = CL_OUT_OF_HOST_MEMORY;
+        goto cleanup;
+    }
+
+    err = SetComputeKernelArgs(output, iterations, width, height, width, max_iter, 
+                               Presets[scene].Origin, Presets[scene].Zoom);
+    if (err)
+    {
+        printf("Failed to set benchmark kernel arguments! %d\n", err);
+        goto cleanup;
+    }
+
+    global[0] = DivideUp(width, WorkGroupSize[0]) * WorkGroupSize[0];
+    global[1] = DivideUp(height, WorkGroupSize[1]) * WorkGroupSize[1];
+    local[0] = WorkGroupSize[0];
+    local[1] = WorkGroupSize[1];
+
+    int run;
+    for(run = 0; run < BENCH_WARMUP_RUNS + BENCH_MEASURED_RUNS; run++)
+    {
+        cl_event first = 0, last = 0;
+        cl_ulong start = 0, end = 0;
+
+        // A persistent frame takes several rounds, so it is timed from the 
+        // start of the first one to the end of the last one
+        //
+        if(persistent)
+        {
+            err = RunPersistentKernel(output, iterations, width, height, width, max_iter, 
+                                      Presets[scene].Origin, Presets[scene].Zoom, &first, &last);
+        }
+        else
+        {
+            err = clEnqueueNDRangeKernel(ComputeCommands, ComputeKernel, 2, NULL, global, local, 0, NULL, &first);
+            if(!err)
+            {
+                clRetainEvent(first);
+                last = first;
+            }
+        }
+
+        if (err || !first || !last)
+        {
+            if(first)
+                clReleaseEvent(first);
+            if(last)
+                clReleaseEvent(last);
+
+            printf("Failed to enqueue benchmark kernel! %d\n", err);
+            err = err ? err : -1;
+            goto cleanup;
+        }
+
+        err = clWaitForEvents(1, &last);
+        err |= clGetEventProfilingInfo(first, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+        err |= clGetEventProfilingInfo(last, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+        clReleaseEvent(first);
+        clReleaseEvent(last);
+        if (err)
+        {
+            printf("Failed to read kernel profiling info! %d\n", err);
+            goto cleanup;
+        }
+
+        if(run >= BENCH_WARMUP_RUNS)
+            times[run - BENCH_WARMUP_RUNS] = (end - start) * 1e-6;
+    }
+
+    err = clEnqueueReadBuffer(ComputeCommands, iterations, CL_TRUE, 0, sizeof(cl_int) * count, host_iterations, 0, NULL, NULL);
+    if (err)
+    {
+        printf("Failed to read benchmark iteration counts! %d\n", err);
+        goto cleanup;
+    }
+
+    // The kernel stores the index of the escaping iteration, so an escaped 
+    // pixel has executed one more iteration than its recorded count
+    //
+    double total_iterations = 0;
+    size_t i;
+    for(i = 0; i < count; i++)
+        total_iterations += (host_iterations[i] < max_iter) ? host_iterations[i] + 1 : max_iter;
+
+    qsort(times, BENCH_MEASURED_RUNS, sizeof(double), CompareDoubles);
+
+    result->Scene = scene;
+    result->Width = width;
+    result->Height = height;
+    result->MaxIterations = max_iter;
+    result->MedianMs = (BENCH_MEASURED_RUNS % 2) ? times[BENCH_MEASURED_RUNS / 2] :
+                       0.5 * (times[BENCH_MEASURED_RUNS / 2 - 1] + times[BENCH_MEASURED_RUNS / 2]);
+    // Nearest rank, with 20 runs this is the second slowest rather than the worst
+    //
+    result->P95Ms = times[DivideUp(BENCH_MEASURED_RUNS * 95, 100) - 1];
+    result->MPixelsPerSec = count / (result->MedianMs * 1e-3) * 1e-6;
+    result->GIterationsPerSec = total_iterations / (result->MedianMs * 1e-3) * 1e-9;
+
+cleanup:
+    if(output)
+        clReleaseMemObject(output);
+    if(iterations)
+        clReleaseMemObject(iterations);
+    free(host_iterations);
+
+    return err;
+}
+
+static int WriteBenchmarkResults(const char *file_name, const BenchResult *results, int count)
+{
+    FILE *file = fopen(file_name, "w");
+    if (!file)
+    {
+        printf("Error opening file %s\n", file_name);
+        return -1;
+    }
+
+    // One result per line, so that CompareBenchmarkResults can read it back 
+    // without a full JSON parser
+    //
+    fprintf(file, "{\n");
+    fprintf(file, "  \"warmup_runs\": %d,\n", BENCH_WARMUP_RUNS);
+    fprintf(file, "  \"measured_runs\": %d,\n", BENCH_MEASURED_RUNS);
+    fprintf(file, "  \"results\": [\n");
+
+    int i;
+    for(i = 0; i < count; i++)
+    {
+        const BenchResult *r = &results[i];
+        fprintf(file, "    {\"backend\": \"%s\", \"number_type\": \"%s\", \"kernel\": \"%s\", \"fractal\": \"%s\", \"scene\": %d, "
+                      "\"width\": %d, \"height\": %d, "
+                      "\"max_iterations\": %d, \"median_ms\": %f, \"p95_ms\": %f, \"mpixels_per_s\": %f, "
+                      "\"giterations_per_s\": %f, \"device\": \"%s\"}%s\n",
+                r->Backend, r->NumberType, r->Kernel, r->Fractal, r->Scene, r->Width, r->Height, r->MaxIterations, 
+                r->MedianMs, r->P95Ms, r->MPixelsPerSec, r->GIterationsPerSec, r->Device,
+                (i + 1 < count) ? "," : "");
+    }
+
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+    fclose(file);
+
+    printf("Wrote %d benchmark results to '%s'\n", count, file_name);
+    return CL_SUCCESS;
+}
+
+static int CompareBenchmarkResults(const char *file_name, const BenchResult *results, int count, double threshold)
+{
+    char line[1024];
+    int regressions = 0;
+    int rows = 0;
+    int matched = 0;
+    int missing = 0;
+
+    FILE *file = fopen(file_name, "r");
+    if (!file)
+    {
+        printf("Error opening file %s\n", file_name);
+        return -1;
+    }
+
+    char *found = (char*)calloc(count ? count : 1, sizeof(char));
+    if (!found)
+    {
+        printf("Failed to allocate comparison state!\n");
+        fclose(file);
+        return -1;
+    }
+
+    printf(SEPARATOR);
+    printf("Comparing against baseline '%s' (threshold %.1f%%)...\n", file_name, threshold * 100.0);
+
+    while(fgets(line, sizeof(line), file))
+    {
+        BenchResult base;
+        int fields = sscanf(line, " {\"backend\": \"%7[^\"]\", \"number_type\": \"%15[^\"]\", \"kernel\": \"%15[^\"]\", "
+                                  "\"fractal\": \"%15[^\"]\", \"scene\": %d, "
+                                  "\"width\": %d, \"height\": %d, \"max_iterations\": %d, \"median_ms\": %lf, "
+                                  "\"p95_ms\": %lf, \"mpixels_per_s\": %lf, \"giterations_per_s\": %lf",
+                            base.Backend, base.NumberType, base.Kernel, base.Fractal, &base.Scene, &base.Width, &base.Height, 
+                            &base.MaxIterations, &base.MedianMs, &base.P95Ms, &base.MPixelsPerSec, 
+                            &base.GIterationsPerSec);
+        if(fields != 12)
+            continue;
+
+        rows++;
+
+        int i;
+        for(i = 0; i < count; i++)
+        {
+            const BenchResult *r = &results[i];
+            if(strcmp(r->Backend, base.Backend) || strcmp(r->NumberType, base.NumberType) || strcmp(r->Kernel, base.Kernel) ||
+               strcmp(r->Fractal, base.Fractal) || r->Scene != base.Scene || r->Width != base.Width || r->Height != base.Height ||
+               r->MaxIterations != base.MaxIterations)
+                continue;
+
+            double ratio = r->MPixelsPerSec / base.MPixelsPerSec;
+            int regressed = ratio < (1.0 - threshold);
+            regressions += regressed;
+            matched += !found[i];
+            found[i] = 1;
+
+            printf("%s [%s %-7s %-10s] scene %d %4dx%-4d iter %4d: %10.3f -> %10.3f Mpixels/s (%+.1f%%)\n",
+                   regressed ? "FAIL" : "ok  ", r->Backend, r->NumberType, r->Kernel, r->Scene, r->Width, r->Height,
+                   r->MaxIterations, base.MPixelsPerSec, r->MPixelsPerSec, (ratio - 1.0) * 100.0);
+            break;
+        }
+    }
+
+    fclose(file);
+
+    // A baseline from an older format parses to nothing or matches nothing, 
+    // which must not pass as "no regressions"
+    //
+    int i;
+    for(i = 0; i < count; i++)
+    {
+        if(found[i])
+            continue;
+
+        const BenchResult *r = &results[i];
+        printf("MISS [%s %-7s %-10s] scene %d %4dx%-4d iter %4d: no baseline result\n",
+               r->Backend, r->NumberType, r->Kernel, r->Scene, r->Width, r->Height, r->MaxIterations);
+        missing++;
+    }
+    free(found);
+
+    if(!rows || !matched)
+    {
+        printf("Error: baseline '%s' has %d readable result(s), %d matched!\n", file_name, rows, matched);
+        return -1;
+    }
+
+    printf("%d of %d result(s) matched, %d regression(s) beyond threshold, %d without baseline\n", 
+           matched, count, regressions, missing);
+    return regressions + missing;
+}
+
+static int RunBenchmark(int use_gpu, int use_cpu, const char *output, const char *baseline, double threshold)
+{
+    int err = CL_SUCCESS;
+    int backends[2] = { use_gpu, use_cpu };
+    int max_results = 2 * BENCH_NUMBER_TYPE_COUNT * BENCH_KERNEL_COUNT * PRESET_COUNT * BENCH_SIZE_COUNT * BENCH_ITERATION_COUNT;
+    int count = 0;
+
+    BenchResult *results = (BenchResult*)calloc(max_results, sizeof(BenchResult));
+    if (!results)
+    {
+        printf("Failed to allocate benchmark results!\n");
+        return -1;
+    }
+
+    ProfilingEnabled = 1;
+
+    int b, n, k, p, z, m;
+    for(b = 0; b < 2; b++)
+    {
+        if(!backends[b])
+            continue;
+
+        err = SetupComputeDevices(b == 0);
+        if(err != CL_SUCCESS)
+        {
+            printf ("Failed to connect to compute device! Error %d\n", err);
+            goto cleanup;
+        }
+
+        for(n = 0; n < BENCH_NUMBER_TYPE_COUNT; n++)
+        {
+            strncpy(ComputeBuildOptions, BenchNumberTypes[n][1], sizeof(ComputeBuildOptions) - 1);
+
+            err = SetupComputeKernel();
+            if (err != CL_SUCCESS)
+            {
+                printf ("Failed to setup compute kernel! Error %d\n", err);
+                goto cleanup;
+            }
+
+            for(k = 0; k < BENCH_KERNEL_COUNT; k++)
+            for(p = 0; p < PRESET_COUNT; p++)
+            for(z = 0; z < BENCH_SIZE_COUNT; z++)
+            for(m = 0; m < BENCH_ITERATION_COUNT; m++)
+            {
+                BenchResult *r = &results[count];
+                strncpy(r->Backend, (b == 0) ? "gpu" : "cpu", sizeof(r->Backend) - 1);
+                strncpy(r->NumberType, BenchNumberTypes[n][0], sizeof(r->NumberType) - 1);
+                strncpy(r->Kernel, BenchKernels[k], sizeof(r->Kernel) - 1);
+                snprintf(r->Fractal, sizeof(r->Fractal), "%s%d", FractalNames[Fractal], FractalExponent);
+                strncpy(r->Device, ComputeDeviceName, sizeof(r->Device) - 1);
+
+                err = BenchmarkScene(k == 1, p, BenchSizes[z], BenchSizes[z], BenchIterations[m], r);
+                if (err != CL_SUCCESS)
+                    goto cleanup;
+
+                printf("[%s %-7s %-10s] scene %d %4dx%-4d iter %4d: median %9.3f ms p95 %9.3f ms %10.3f Mpixels/s %8.3f Giterations/s\n",
+                       r->Backend, r->NumberType, r->Kernel, r->Scene, r->Width, r->Height, r->MaxIterations,
+                       r->MedianMs, r->P95Ms, r->MPixelsPerSec, r->GIterationsPerSec);
+                count++;
+            }
+        }
+
+        Cleanup();
+    }
+
+    err = WriteBenchmarkResults(output, results, count);
+    if(err == CL_SUCCESS && baseline)
+        err = CompareBenchmarkResults(baseline, results, count, threshold) ? EXIT_FAILURE : CL_SUCCESS;
+
+cleanup:
+    Cleanup();
+    free(results);
+    return err;
+}
+
 int main(int argc, char** argv)
 {
     // Parse command line options
     //
     int i;
     int use_gpu = 1;
+    int bench = 0;
+    int bench_gpu = 0;
+    int bench_cpu = 0;
+    const char *bench_output = BENCH_DEFAULT_OUTPUT;
+    const char *bench_baseline = NULL;
+    double bench_threshold = BENCH_DEFAULT_THRESHOLD;
     for(i = 0; i < argc && argv; i++)
     {
         if(!argv[i])
             continue;
             
-        if(strstr(argv[i], "cpu"))
+        if(!strncmp(argv[i], "--bench-out=", 12))
+            bench_output = argv[i] + 12;
+
+        else if(!strncmp(argv[i], "--bench-compare=", 16))
+            bench_baseline = argv[i] + 16;
+
+        else if(!strncmp(argv[i], "--bench-threshold=", 18))
+            bench_threshold = atof(argv[i] + 18);
+
+        else if(!strcmp(argv[i], "bench"))
+            bench = 1;
+
+        else if(!strcmp(argv[i], "persistent"))
+            UsePersistentThreads = 1;
+
+        else if(!strcmp(argv[i], "julia"))
+            Fractal = FRACTAL_JULIA;
+
+        else if(!strcmp(argv[i], "burningship"))
+            Fractal = FRACTAL_BURNING_SHIP;
+
+        else if(!strncmp(argv[i], "--julia-c=", 10))
+        {
+            if(sscanf(argv[i] + 10, "%f,%f", &JuliaC[0], &JuliaC[1]) != 2)
+            {
+                printf("Julia c must be given as RE,IM\n");
+                return EXIT_FAILURE;
+            }
+        }
+
+        else if(!strncmp(argv[i], "--exponent=", 11))
+        {
+            FractalExponent = atoi(argv[i] + 11);
+            if(FractalExponent < FRACTAL_MIN_EXPONENT || FractalExponent > FRACTAL_MAX_EXPONENT)
+            {
+                printf("Exponent must be between %d and %d\n", FRACTAL_MIN_EXPONENT, FRACTAL_MAX_EXPONENT);
+                return EXIT_FAILURE;
+            }
+        }
+
+        else if(strstr(argv[i], "cpu"))
+        {
             use_gpu = 0;        
+            bench_cpu = 1;
+        }
 
         else if(strstr(argv[i], "gpu"))
+        {
             use_gpu = 1;
+            bench_gpu = 1;
+        }
     }
     
     glutInit(&argc, argv);
@@ -805,9 +2269,18 @@ int main(int argc, char** argv)
     glutInitWindowPosition(100, 100);
     glutCreateWindow(argv[0]);
 
+    if (bench)
+    {
+        if(!bench_gpu && !bench_cpu)
+            bench_gpu = bench_cpu = 1;
+
+        return RunBenchmark(bench_gpu, bench_cpu, bench_output, bench_baseline, bench_threshold);
+    }
+
     if (Initialize(use_gpu) == GL_NO_ERROR)
     {
         glutDisplayFunc(Display);
+        glutReshapeFunc(Reshape);
         glutIdleFunc(Idle);
         glutKeyboardFunc(Keyboard);
 
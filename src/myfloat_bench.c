@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+#include <time.h>
+
+#include "myfloat.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+#define SEPARATOR                       ("----------------------------------------------------------------------\n")
+#define FUZZ_DEFAULT_CASES              (100000)
+#define FUZZ_DEFAULT_SEED               (1)
+#define FUZZ_MIN_EXPONENT               (-60)   // DEEP PRESETS REACH 2^-27, THEIR SQUARES 2^-54
+#define FUZZ_MAX_EXPONENT               (8)
+#define FUZZ_REPORTED_FAILURES          (5)
+#define FUZZ_MAX_ULP_ERROR              (1.0)   // IN FLOAT ULPS
+#define BENCH_DEFAULT_OPS               (200000)
+#define BENCH_OPERANDS                  (1024)  // MUST BE A POWER OF TWO
+
+////////////////////////////////////////////////////////////////////////////////
+
+typedef enum
+{
+    OP_CONVERT,
+    OP_ADD,
+    OP_SUBTRACT,
+    OP_MULTIPLY,
+    OP_COMPARE,
+    OP_COUNT
+} Operation;
+
+static const char *OperationNames[OP_COUNT] = { "convertFromFloat", "add", "subtract", "multiply", "compare" };
+
+typedef struct
+{
+    long Cases;
+    long Failures;
+    double MaxUlp;
+    double SumUlp;
+} FuzzStats;
+
+static uint64_t RandomState = FUZZ_DEFAULT_SEED;
+
+// Keeps the benchmark loops from being optimized away
+static volatile int SinkInt;
+
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t NextRandom(void)
+{
+    // xorshift64*, deterministic for a given seed so failures can be replayed
+    RandomState ^= RandomState >> 12;
+    RandomState ^= RandomState << 25;
+    RandomState ^= RandomState >> 27;
+    return RandomState * 2685821657736338717ULL;
+}
+
+static float RandomFloat(void)
+{
+    uint64_t r = NextRandom();
+    int exponent = FUZZ_MIN_EXPONENT + (int)((r >> 32) % (FUZZ_MAX_EXPONENT - FUZZ_MIN_EXPONENT + 1));
+    float mantissa = 1.0f + (float)(r & 0xFFFFFF) / (float)0x1000000;
+    float value = ldexpf(mantissa, exponent);
+
+    // Small integers and exact zero show up all the time in the kernel
+    switch((r >> 24) & 0xF)
+    {
+        case 0: return 0.0f;
+        case 1: return (float)((int)((r >> 40) % 9) - 4);
+        default: break;
+    }
+
+    return (r & (1ULL << 63)) ? -value : value;
+}
+
+static double GetAsDouble(myFloat mF)
+{
+    double res = 0;
+    int i;
+    for(i = 0; i < MYFLOAT_MANT_SIZE; ++i)
+        if(mF.mant[i])
+            res += ldexp(1.0, mF.exp - MYFLOAT_MANT_SIZE + 1 + i);
+
+    return mF.sign ? -res : res;
+}
+
+static double UlpError(double value, double reference)
+{
+    // Measured in float ULPs of the reference, the precision the kernel
+    // would get from native floats
+    double ulp = (reference == 0.0) ? ldexp(1.0, -149) :
+                 ldexp(1.0, ilogb(reference) - (FLT_MANT_DIG - 1));
+    return fabs(value - reference) / ulp;
+}
+
+static double GetTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void RecordCase(FuzzStats *stats, Operation op, float a, float b, double value, double reference)
+{
+    // compare has no precision, any difference is a failure
+    double ulp = (op == OP_COMPARE) ? (value != reference) : UlpError(value, reference);
+    double tolerance = (op == OP_COMPARE) ? 0.0 : FUZZ_MAX_ULP_ERROR;
+
+    stats->Cases++;
+    stats->SumUlp += ulp;
+    if(ulp > stats->MaxUlp)
+        stats->MaxUlp = ulp;
+
+    if(ulp > tolerance)
+    {
+        if(stats->Failures < FUZZ_REPORTED_FAILURES)
+            printf("  %-16s a = %.9g b = %.9g: got %.17g expected %.17g (%.1f ulp)\n",
+                   OperationNames[op], a, b, value, reference, ulp);
+        stats->Failures++;
+    }
+}
+
+static int CheckSpecialValues(void)
+{
+    int failures = 0;
+
+    myFloat inf = createMyFloat();
+    inf.exp = 128;
+    inf.mant[MYFLOAT_MANT_SIZE - 1] = true;
+
+    myFloat negInf = inf;
+    negInf.sign = true;
+
+    myFloat nan = inf;
+    nan.mant[0] = true;
+
+    myFloat one = convertFromFloat(1.0f);
+
+    struct { const char *Name; bool Value; bool Expected; } checks[] = {
+        { "isInf(+inf)",     isInf(inf),        true  },
+        { "isInf(-inf)",     isInf(negInf),     false },
+        { "isInf(nan)",      isInf(nan),        false },
+        { "isInf(1)",        isInf(one),        false },
+        { "isNegInf(-inf)",  isNegInf(negInf),  true  },
+        { "isNegInf(+inf)",  isNegInf(inf),     false },
+        { "isNegInf(1)",     isNegInf(one),     false },
+        { "isNaN(nan)",      isNaN(nan),        true  },
+        { "isNaN(+inf)",     isNaN(inf),        false },
+        { "isNaN(1)",        isNaN(one),        false },
+    };
+
+    size_t i;
+    for(i = 0; i < sizeof(checks) / sizeof(checks[0]); i++)
+    {
+        if(checks[i].Value != checks[i].Expected)
+        {
+            printf("  %-16s returned %s\n", checks[i].Name, checks[i].Value ? "true" : "false");
+            failures++;
+        }
+    }
+
+    printf("Special values: %d failure(s)\n", failures);
+    return failures;
+}
+
+static int RunFuzzer(long cases)
+{
+    FuzzStats stats[OP_COUNT];
+    int op;
+    long n;
+
+    memset(stats, 0, sizeof(stats));
+
+    printf(SEPARATOR);
+    printf("Fuzzing %ld cases per operation against IEEE double (seed %llu)...\n",
+           cases, (unsigned long long)RandomState);
+
+    for(op = 0; op < OP_COUNT; op++)
+    {
+        for(n = 0; n < cases; n++)
+        {
+            float a = RandomFloat();
+            float b = RandomFloat();
+            myFloat mA = convertFromFloat(a);
+            myFloat mB = convertFromFloat(b);
+
+            // The reference works on the converted operands, so conversion
+            // error is only charged to OP_CONVERT
+            double dA = GetAsDouble(mA);
+            double dB = GetAsDouble(mB);
+
+            switch(op)
+            {
+                case OP_CONVERT:
+                    RecordCase(&stats[op], op, a, b, dA, a);
+                    break;
+
+                case OP_ADD:
+                    RecordCase(&stats[op], op, a, b, GetAsDouble(add(mA, mB)), dA + dB);
+                    break;
+
+                case OP_SUBTRACT:
+                    RecordCase(&stats[op], op, a, b, GetAsDouble(subtract(mA, mB)), dA - dB);
+                    break;
+
+                case OP_MULTIPLY:
+                    RecordCase(&stats[op], op, a, b, GetAsDouble(multiply(mA, mB)), dA * dB);
+                    break;
+
+                case OP_COMPARE:
+                {
+                    int expected = (dA > dB) - (dA < dB);
+                    int value = compare(mA, mB);
+                    RecordCase(&stats[op], op, a, b, value, expected);
+                    break;
+                }
+            }
+        }
+    }
+
+    int failures = CheckSpecialValues();
+
+    printf("%-16s %10s %10s %12s %12s\n", "operation", "cases", "failures", "max ulp", "mean ulp");
+    printf("(float ulps of the double result, compare counts mismatches)\n");
+    for(op = 0; op < OP_COUNT; op++)
+    {
+        printf("%-16s %10ld %10ld %12.3f %12.3f\n", OperationNames[op], stats[op].Cases, stats[op].Failures,
+               stats[op].MaxUlp, stats[op].Cases ? stats[op].SumUlp / stats[op].Cases : 0.0);
+        failures += stats[op].Failures > 0;
+    }
+
+    return failures;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void ReportBenchmark(const char *representation, const char *name, double seconds, long ops)
+{
+    printf("%-8s %-16s %12.2f ns/op %14.0f ops/s\n", representation, name, seconds * 1e9 / ops, ops / seconds);
+}
+
+static int MyFloatBit(myFloat mF, long n)
+{
+    return mF.mant[n % MYFLOAT_MANT_SIZE];
+}
+
+static int FloatBit(float f, long n)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return (u >> (n % 23)) & 1;
+}
+
+static void RunBenchmark(long ops)
+{
+    float floats[BENCH_OPERANDS];
+    myFloat myFloats[BENCH_OPERANDS];
+    double start;
+    long n;
+    int i;
+
+    for(i = 0; i < BENCH_OPERANDS; i++)
+    {
+        floats[i] = RandomFloat();
+        myFloats[i] = convertFromFloat(floats[i]);
+    }
+
+    printf(SEPARATOR);
+    printf("Timing %ld ops per operation...\n", ops);
+
+    // Both representations run the same loop shape: independent operations 
+    // on the same operands, with one mantissa bit of every result folded into 
+    // an integer sink. This measures throughput, and it avoids getAsFloat 
+    // and its pow calls inside the timed loops
+    //
+    int bits = 0;
+    int cmp = 0;
+
+    // myFloat
+
+    start = GetTime();
+    for(n = 0; n < ops; n++)
+        bits ^= MyFloatBit(convertFromFloat(floats[n & (BENCH_OPERANDS - 1)]), n);
+    ReportBenchmark("myFloat", "convertFromFloat", GetTime() - start, ops);
+
+    start = GetTime();
+    for(n = 0; n < ops; n++)
+        bits ^= MyFloatBit(add(myFloats[n & (BENCH_OPERANDS - 1)], myFloats[(n + 1) & (BENCH_OPERANDS - 1)]), n);
+    ReportBenchmark("myFloat", "add", GetTime() - start, ops);
+
+    start = GetTime();
+    for(n = 0; n < ops; n++)
+        bits ^= MyFloatBit(subtract(myFloats[n & (BENCH_OPERANDS - 1)], myFloats[(n + 1) & (BENCH_OPERANDS - 1)]), n);
+    ReportBenchmark("myFloat", "subtract", GetTime() - start, ops);
+
+    start = GetTime();
+    for(n = 0; n < ops; n++)
+        bits ^= MyFloatBit(multiply(myFloats[n & (BENCH_OPERANDS - 1)], myFloats[(n + 1) & (BENCH_OPERANDS - 1)]), n);
+    ReportBenchmark("myFloat", "multiply", GetTime() - start, ops);
+
+    start = GetTime();
+    for(n = 0; n < ops; n++)
+        cmp += compare(myFloats[n & (BENCH_OPERANDS - 1)], myFloats[(n + 1) & (BENCH_OPERANDS - 1)]);
+    ReportBenchmark("myFloat", "compare", GetTime() - start, ops);
+
+    start = GetTime();
+    for(n = 0; n < ops; n++)
+        cmp += isNaN(myFloats[n & (BENCH_OPERANDS - 1)]) + isInf(myFloats[n & (BENCH_OPERANDS - 1)]);
+    ReportBenchmark("myFloat", "isNaN + isInf", GetTime() - start, ops);
+
+    // Native float, the baseline every myFloat number is measured against. A 
+    // float is already its own representation, so converting is only the load
+
+    start = GetTime();
+    for(n = 0; n < ops; n++)
+        bits ^= FloatBit(floats[n & (BENCH_OPERANDS - 1)], n);
+    ReportBenchmark("float", "convertFromFloat", GetTime() - start, ops);
+
+    start = GetTime();
+    for(n = 0; n < ops; n++)
+        bits ^= FloatBit(floats[n & (BENCH_OPERANDS - 1)] + floats[(n + 1) & (BENCH_OPERANDS - 1)], n);
+    ReportBenchmark("float", "add", GetTime() - start, ops);
+
+    start = GetTime();
+    for(n = 0; n < ops; n++)
+        bits ^= FloatBit(floats[n & (BENCH_OPERANDS - 1)] - floats[(n + 1) & (BENCH_OPERANDS - 1)], n);
+    ReportBenchmark("float", "subtract", GetTime() - start, ops);
+
+    start = GetTime();
+    for(n = 0; n < ops; n++)
+        bits ^= FloatBit(floats[n & (BENCH_OPERANDS - 1)] * floats[(n + 1) & (BENCH_OPERANDS - 1)], n);
+    ReportBenchmark("float", "multiply", GetTime() - start, ops);
+
+    start = GetTime();
+    for(n = 0; n < ops; n++)
+    {
+        float lhs = floats[n & (BENCH_OPERANDS - 1)];
+        float rhs = floats[(n + 1) & (BENCH_OPERANDS - 1)];
+        cmp += (lhs > rhs) - (lhs < rhs);
+    }
+    ReportBenchmark("float", "compare", GetTime() - start, ops);
+
+    start = GetTime();
+    for(n = 0; n < ops; n++)
+        cmp += (isnan(floats[n & (BENCH_OPERANDS - 1)]) != 0) + (isinf(floats[n & (BENCH_OPERANDS - 1)]) != 0);
+    ReportBenchmark("float", "isNaN + isInf", GetTime() - start, ops);
+
+    SinkInt = bits + cmp;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv)
+{
+    // Parse command line options
+    //
+    int i;
+    int fuzz = 0;
+    int bench = 0;
+    long cases = FUZZ_DEFAULT_CASES;
+    long ops = BENCH_DEFAULT_OPS;
+    for(i = 1; i < argc; i++)
+    {
+        if(!strncmp(argv[i], "--cases=", 8))
+            cases = atol(argv[i] + 8);
+
+        else if(!strncmp(argv[i], "--ops=", 6))
+            ops = atol(argv[i] + 6);
+
+        else if(!strncmp(argv[i], "--seed=", 7))
+            RandomState = strtoull(argv[i] + 7, NULL, 10);
+
+        else if(!strcmp(argv[i], "fuzz"))
+            fuzz = 1;
+
+        else if(!strcmp(argv[i], "bench"))
+            bench = 1;
+
+        else
+        {
+            printf("Usage: %s [fuzz] [bench] [--cases=N] [--ops=N] [--seed=N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(!fuzz && !bench)
+        fuzz = bench = 1;
+
+    if(!RandomState)
+        RandomState = FUZZ_DEFAULT_SEED;
+
+    int failures = 0;
+
+    if(fuzz)
+        failures = RunFuzzer(cases);
+
+    if(bench)
+        RunBenchmark(ops);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}